@@ -0,0 +1,210 @@
+#include "bodyrenderer.h"
+
+#ifndef QT_NO_OPENGL
+
+#include <QDebug>
+#include <QMatrix4x4>
+#include <stddef.h>
+
+#include "polygonitem.h"
+#include "utils.h"
+
+static const char* vertexShaderSource =
+        "attribute highp vec2 vertex;\n"
+        "attribute highp vec4 pose;\n"      // x, y, angle, scale
+        "attribute lowp vec4 color;\n"
+        "uniform highp mat4 matrix;\n"
+        "varying lowp vec4 fragmentColor;\n"
+        "void main()\n"
+        "{\n"
+        "    highp float c = cos(pose.z);\n"
+        "    highp float s = sin(pose.z);\n"
+        "    highp vec2 v = pose.w * vertex;\n"
+        "    highp vec2 p = pose.xy + vec2(c * v.x - s * v.y, s * v.x + c * v.y);\n"
+        "    gl_Position = matrix * vec4(p, 0.0, 1.0);\n"
+        "    fragmentColor = color;\n"
+        "}\n";
+
+static const char* fragmentShaderSource =
+        "varying lowp vec4 fragmentColor;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = fragmentColor;\n"
+        "}\n";
+
+
+BodyRenderer::BodyRenderer()
+    :shapeBuffer(QGLBuffer::VertexBuffer), indexBuffer(QGLBuffer::IndexBuffer),
+      poseBuffer(QGLBuffer::VertexBuffer)
+{
+    initialized = false;
+    usable = false;
+    dirty = true;
+
+    vertexLocation = poseLocation = colorLocation = matrixLocation = -1;
+    vertexCount = 0;
+    indexCount = 0;
+}
+
+BodyRenderer::~BodyRenderer()
+{
+}
+
+bool BodyRenderer::Init()
+{
+    if(!QGLShaderProgram::hasOpenGLShaderPrograms())
+        return false;
+
+    if(!program.addShaderFromSourceCode(QGLShader::Vertex, vertexShaderSource)
+            || !program.addShaderFromSourceCode(QGLShader::Fragment, fragmentShaderSource)
+            || !program.link()){
+        qDebug()<<"body renderer disabled:"<<program.log();
+        return false;
+    }
+
+    vertexLocation = program.attributeLocation("vertex");
+    poseLocation = program.attributeLocation("pose");
+    colorLocation = program.attributeLocation("color");
+    matrixLocation = program.uniformLocation("matrix");
+
+    shapeBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    indexBuffer.setUsagePattern(QGLBuffer::StaticDraw);
+    poseBuffer.setUsagePattern(QGLBuffer::StreamDraw);
+    return shapeBuffer.create() && indexBuffer.create() && poseBuffer.create();
+}
+
+void BodyRenderer::Rebuild(const QVector<PolygonItem*>& items)
+{
+    batches.resize(0);
+    shapeData.resize(0);
+    indexData.resize(0);
+    vertexCount = 0;
+
+    for(int slot=0; slot<items.size(); slot++){
+        PolygonItem* item = items.at(slot);
+        if(!item || item->UsesTexture())
+            continue;
+
+        const QVector<QPointF>& outline = item->GetOutline();
+        int count = outline.size();
+        if(count < 3)
+            continue;
+
+        Batch batch = {slot, item->GetBodyHandle(), vertexCount, count};
+        batches.append(batch);
+
+        for(int i=0; i<count; i++){
+            shapeData.append((GLfloat)outline.at(i).x());
+            shapeData.append((GLfloat)outline.at(i).y());
+        }
+
+        // The shapes are convex, a fan covers them.
+        for(int i=1; i<count-1; i++){
+            indexData.append(vertexCount);
+            indexData.append(vertexCount + i);
+            indexData.append(vertexCount + i + 1);
+        }
+        vertexCount += count;
+    }
+    indexCount = indexData.size();
+
+    shapeBuffer.bind();
+    shapeBuffer.allocate(shapeData.constData(), shapeData.size() * sizeof(GLfloat));
+    shapeBuffer.release();
+    indexBuffer.bind();
+    indexBuffer.allocate(indexData.constData(), indexData.size() * sizeof(GLuint));
+    indexBuffer.release();
+
+    poseData.resize(vertexCount);
+    dirty = false;
+}
+
+bool BodyRenderer::Draw(const QTransform& view, int width, int height,
+                        const QVector<PolygonItem*>& items, const PoseSnapshot& snapshot, float32 alpha)
+{
+    if(!initialized){
+        initialized = true;
+        usable = Init();
+    }
+    if(!usable)
+        return false;
+
+    if(dirty)
+        Rebuild(items);
+    if(indexCount == 0)
+        return true;
+
+    PoseVertex* out = poseData.data();
+    for(int b=0; b<batches.size(); b++){
+        const Batch& batch = batches.at(b);
+        PolygonItem* item = batch.slot < items.size() ? items.at(batch.slot) : NULL;
+
+        PoseVertex vertex;
+        memset(&vertex, 0, sizeof(vertex));
+        if(!item || item->GetBodyHandle() != batch.body || item->UsesTexture()){
+            // Gone or textured since the upload, collapse it until the next one.
+            dirty = true;
+        } else if(item->isVisible()){
+            const BodyPose* pose = snapshot.Find(batch.body);
+            if(pose){
+                P2DVec2 position = (1.0f - alpha) * pose->previousPosition + alpha * pose->position;
+                QPointF p = CoordinateInterface::MapToScene(position);
+                vertex.x = (GLfloat)p.x();
+                vertex.y = (GLfloat)p.y();
+                vertex.angle = (1.0f - alpha) * pose->previousAngle + alpha * pose->angle;
+            } else {
+                // Not published yet, it is still where it was created.
+                vertex.x = (GLfloat)item->pos().x();
+                vertex.y = (GLfloat)item->pos().y();
+                vertex.angle = (GLfloat)CoordinateInterface::DegToRad(item->rotation());
+            }
+            vertex.scale = 1.0f;
+
+            QColor c = item->GetDrawColor();
+            vertex.color[0] = (GLubyte)c.red();
+            vertex.color[1] = (GLubyte)c.green();
+            vertex.color[2] = (GLubyte)c.blue();
+            vertex.color[3] = (GLubyte)c.alpha();
+        }
+
+        for(int i=0; i<batch.count; i++)
+            *out++ = vertex;
+    }
+
+    QMatrix4x4 matrix;
+    matrix.ortho(0, width, height, 0, -1, 1);
+    matrix *= QMatrix4x4(view);
+
+    program.bind();
+    program.setUniformValue(matrixLocation, matrix);
+
+    shapeBuffer.bind();
+    program.enableAttributeArray(vertexLocation);
+    program.setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 2);
+
+    poseBuffer.bind();
+    poseBuffer.allocate(poseData.constData(), poseData.size() * sizeof(PoseVertex));
+    program.enableAttributeArray(poseLocation);
+    program.setAttributeBuffer(poseLocation, GL_FLOAT, offsetof(PoseVertex, x), 4, sizeof(PoseVertex));
+    program.enableAttributeArray(colorLocation);
+    program.setAttributeBuffer(colorLocation, GL_UNSIGNED_BYTE, offsetof(PoseVertex, color), 4, sizeof(PoseVertex));
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    indexBuffer.bind();
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    indexBuffer.release();
+
+    program.disableAttributeArray(colorLocation);
+    program.disableAttributeArray(poseLocation);
+    program.disableAttributeArray(vertexLocation);
+    poseBuffer.release();
+    program.release();
+
+    return true;
+}
+
+#endif // QT_NO_OPENGL
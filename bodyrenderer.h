@@ -0,0 +1,86 @@
+#ifndef BODYRENDERER_H
+#define BODYRENDERER_H
+
+#ifndef QT_NO_OPENGL
+
+#include <QTransform>
+#include <QVector>
+#include <QGLShaderProgram>
+#include <QGLBuffer>
+
+#include "physicsthread.h"
+
+class PolygonItem;
+
+/// Draws all the untextured bodies of a scene in one draw call on a GL
+/// viewport, instead of one QPainter path per item.
+/// The local outlines of the shapes are uploaded once, fan triangulated,
+/// and only rebuilt when bodies come or go. Every frame the pose and colour
+/// of each body are streamed per vertex and a vertex shader places the
+/// shapes. This only needs GLSL 1.10 and vertex buffers, no instancing, so
+/// it runs on software Mesa as well.
+class BodyRenderer
+{
+public:
+    BodyRenderer();
+    ~BodyRenderer();
+
+    /// Mark the set of shapes as changed, they are uploaded again on the next draw.
+    void Invalidate() {dirty = true;}
+
+    /// Draw the bodies. A GL context must be current, e.g. between
+    /// QPainter::beginNativePainting and endNativePainting.
+    /// @param view maps scene coordinates to the pixels of the viewport.
+    /// @param items the items of the bodies, indexed by body slot.
+    /// @param snapshot the poses to draw, interpolated by alpha.
+    /// @return false if GL can't do it, the items have to paint themselves then.
+    bool Draw(const QTransform& view, int width, int height,
+              const QVector<PolygonItem*>& items, const PoseSnapshot& snapshot, float32 alpha);
+
+private:
+    bool Init();
+    void Rebuild(const QVector<PolygonItem*>& items);
+
+    // A body's vertices in the shape buffer.
+    struct Batch
+    {
+        int slot;
+        P2DHandle body;
+        int first;
+        int count;
+    };
+
+    // The per frame data of a vertex.
+    struct PoseVertex
+    {
+        GLfloat x, y, angle;
+        GLfloat scale;      // 0 collapses a body that is not drawn
+        GLubyte color[4];
+    };
+
+    bool initialized;
+    bool usable;
+    bool dirty;
+
+    QGLShaderProgram program;
+    int vertexLocation;
+    int poseLocation;
+    int colorLocation;
+    int matrixLocation;
+
+    QGLBuffer shapeBuffer;  ///< Local vertices, static
+    QGLBuffer indexBuffer;  ///< Fan triangles, static
+    QGLBuffer poseBuffer;   ///< PoseVertex per vertex, streamed
+
+    QVector<Batch> batches;
+    int vertexCount;
+    int indexCount;
+
+    QVector<GLfloat> shapeData;
+    QVector<GLuint> indexData;
+    QVector<PoseVertex> poseData;
+};
+
+#endif // QT_NO_OPENGL
+
+#endif // BODYRENDERER_H
@@ -48,7 +48,9 @@ MainWindow::MainWindow(QWidget *parent)
     //bgPalette.setBrush(QPalette::Background, QBrush(bg));
     bgPalette.setBrush(QPalette::Background, QBrush(QImage(":images/bg.png")));
     centerScribbleArea->setPalette(bgPalette);
-    playGround->setBackgroundBrush(QBrush(bg));
+    // On the scene rather than the view, a view with a brush of its own never
+    // calls SceneManager::drawBackground, which draws the batched bodies.
+    sceneManager->setBackgroundBrush(QBrush(bg));
 
     centerScribbleArea->setFocusPolicy(Qt::WheelFocus);
 
@@ -68,6 +70,9 @@ MainWindow::MainWindow(QWidget *parent)
 
     //statusBar()->showMessage(tr("Ready"));
 
+    shownDegradeLevel = 0;
+
+    // Only repaints, the scene is stepped by its own physics thread.
     timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(RefreshScene()));
     timer->start(20);
@@ -243,6 +248,28 @@ void MainWindow::setupToolBar()
 
 }
 
+void MainWindow::updateStepStatus()
+{
+    const P2DStepBudgetReport& report = sceneManager->GetStepReport();
+    if(report.degradeLevel == shownDegradeLevel)
+        return;
+    shownDegradeLevel = report.degradeLevel;
+
+    if(report.degradeLevel == 0){
+        statusBar()->clearMessage();
+        return;
+    }
+
+    QString message = tr("Physics over budget (%1 of %2 ms): %3 velocity, %4 position iterations, %5 sub-steps")
+            .arg(report.elapsed, 0, 'f', 1).arg(report.budget, 0, 'f', 1)
+            .arg(report.velocityIterations).arg(report.positionIterations).arg(report.softSubSteps);
+    if(report.deferredTOI)
+        message += tr(", continuous collision for bullets only");
+    if(report.skippedSleep)
+        message += tr(", no sleeping");
+    statusBar()->showMessage(message);
+}
+
 /// @param [in] id Indicate which color to update
 void MainWindow::setColor(int id)
 {
@@ -381,6 +408,11 @@ void MainWindow::setupMenuBar()
     connect(loadAct, &QAction::triggered, sceneManager, &SceneManager::LoadManyMany);
     loadSceneMenu->addAction(loadAct);
 
+    loadSceneMenu->addSeparator();
+    loadAct = new QAction(tr("Benchmark Solvers"), this);
+    connect(loadAct, &QAction::triggered, this, &MainWindow::benchmarkSolvers);
+    loadSceneMenu->addAction(loadAct);
+
 
 
     windowWidgetMenu = menuBar()->addMenu(tr("&Window"));
@@ -599,6 +631,16 @@ void MainWindow::about()
                "it's a tricky reverse of the powerful open software GIMP.</p>"));
 }
 
+void MainWindow::benchmarkSolvers()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QString report = RunStackBenchmark();
+    QApplication::restoreOverrideCursor();
+
+    qDebug()<<qPrintable(report);
+    QMessageBox::information(this, tr("Solver Benchmark"), report);
+}
+
 
 //void MainWindow::setCurrentFile(const QString &fileName)
 //{
@@ -46,6 +46,7 @@
 #include "scenemanager.h"
 #include "params.h"
 #include "polygonitem.h"
+#include "stackbenchmark.h"
 
 class ToolBar;
 QT_FORWARD_DECLARE_CLASS(QMenu)
@@ -74,6 +75,7 @@ private:
     PolygonItem *texturingItem;
 
     QTimer *timer;
+    int shownDegradeLevel;  ///< Degrade level of the step shown in the status bar
     //QBasicTimer videoRecTimer;
     //int timeCounter;
 
@@ -102,6 +104,8 @@ private:
     void setupWindowWidgets();
     /// Switch to a new toolbar on the box when the tool changes
     void switchToolsToolBar(ToolType::toolType newToolType);
+    /// Show in the status bar when the physics steps run over their budget
+    void updateStepStatus();
 
 private slots:
     /// Open a file
@@ -120,6 +124,8 @@ private slots:
 
     /// Show about information
     void about();
+    /// Run the stacking benchmark of the solvers and show the results
+    void benchmarkSolvers();
 
 
     /// Set tool to marquee
@@ -155,6 +161,7 @@ private slots:
     void RefreshScene(){
         sceneManager->Render();
         playGround->updateView();
+        updateStepStatus();
     }
 
     void SwitchToKurssal();
@@ -7,17 +7,16 @@ P2DBTree::P2DBTree()
 
 	m_nodeCapacity = 16;
 	m_nodeCount = 0;
-	m_nodes = (P2DBTreeNode*)MemAlloc(m_nodeCapacity * sizeof(P2DBTreeNode));
-	memset(m_nodes, 0, m_nodeCapacity * sizeof(P2DBTreeNode));
+	m_nodes = (P2DBTreeNode*)MemAlloc(m_nodeCapacity * sizeof(P2DBTreeNode), e_memTreeNodes);
 
 	// Build a linked list for the free list.
-	for (int32 i = 0; i < m_nodeCapacity - 1; ++i)
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
 	{
+		m_nodes[i] = P2DBTreeNode();
 		m_nodes[i].next = i + 1;
 		m_nodes[i].height = -1;
 	}
 	m_nodes[m_nodeCapacity-1].next = NULL_NODE;
-	m_nodes[m_nodeCapacity-1].height = -1;
 	m_freeList = 0;
 
 	m_path = 0;
@@ -42,7 +41,7 @@ int32 P2DBTree::AllocateNode()
 		// The free list is empty. Rebuild a bigger pool.
 		P2DBTreeNode* oldNodes = m_nodes;
 		m_nodeCapacity *= 2;
-		m_nodes = (P2DBTreeNode*)MemAlloc(m_nodeCapacity * sizeof(P2DBTreeNode));
+		m_nodes = (P2DBTreeNode*)MemAlloc(m_nodeCapacity * sizeof(P2DBTreeNode), e_memTreeNodes);
 		memcpy(m_nodes, oldNodes, m_nodeCount * sizeof(P2DBTreeNode));
 		MemFree(oldNodes);
 
@@ -84,7 +83,7 @@ void P2DBTree::FreeNode(int32 nodeId)
 // Create a proxy in the tree as a leaf node. We return the index
 // of the node instead of a pointer so that we can grow
 // the node pool.
-int32 P2DBTree::CreateProxy(const P2DAABB& aabb, void* userData)
+int32 P2DBTree::CreateProxy(const P2DAABB& aabb, void* userData, const P2DProxyFilter& filter)
 {
 	int32 proxyId = AllocateNode();
 
@@ -93,13 +92,36 @@ int32 P2DBTree::CreateProxy(const P2DAABB& aabb, void* userData)
 	m_nodes[proxyId].aabb.lowerBound = aabb.lowerBound - r;
 	m_nodes[proxyId].aabb.upperBound = aabb.upperBound + r;
 	m_nodes[proxyId].userData = userData;
+	m_nodes[proxyId].filter = filter;
 	m_nodes[proxyId].height = 0;
+	m_nodes[proxyId].drift.SetZero();
+	m_nodes[proxyId].motion = 0.0f;
+	m_nodes[proxyId].slackMoves = 0;
 
 	InsertLeaf(proxyId);
 
 	return proxyId;
 }
 
+void P2DBTree::SetFilter(int32 proxyId, const P2DProxyFilter& filter)
+{
+	assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	assert(m_nodes[proxyId].IsLeaf());
+
+	m_nodes[proxyId].filter = filter;
+
+	// Refit the unions of the ancestors.
+	int32 index = m_nodes[proxyId].parent;
+	while (index != NULL_NODE)
+	{
+		int32 child1 = m_nodes[index].child1;
+		int32 child2 = m_nodes[index].child2;
+		m_nodes[index].filter.Combine(m_nodes[child1].filter, m_nodes[child2].filter);
+
+		index = m_nodes[index].parent;
+	}
+}
+
 void P2DBTree::DestroyProxy(int32 proxyId)
 {
 	assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -109,28 +131,64 @@ void P2DBTree::DestroyProxy(int32 proxyId)
 	FreeNode(proxyId);
 }
 
-bool P2DBTree::MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement)
+bool P2DBTree::MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement, bool teleport)
 {
 	assert(0 <= proxyId && proxyId < m_nodeCapacity);
 
 	assert(m_nodes[proxyId].IsLeaf());
 
-	if (m_nodes[proxyId].aabb.Contains(aabb))
+	// Track how the proxy typically moves. Steady motion is predicted along
+	// its direction, only the jitter on top of it needs a margin all around.
+	P2DBTreeNode* node = m_nodes + proxyId;
+	if (teleport == false)
+	{
+		node->drift += P2D_AABB_MOTION_SMOOTHING * (displacement - node->drift);
+		node->motion += P2D_AABB_MOTION_SMOOTHING * (displacement.Length() - node->motion);
+	}
+
+	float32 jitter = P2DMax(node->motion - node->drift.Length(), 0.0f);
+	float32 margin = P2DClamp(P2D_AABB_MARGIN_STEPS * jitter, P2D_AABB_MIN_EXTENSION, P2D_AABB_MAX_EXTENSION);
+
+	// Predict AABB displacement.
+	P2DVec2 d = P2D_AABB_MULTIPLIER * node->drift;
+	float32 prediction = d.Length();
+	if (prediction > P2D_AABB_MAX_PREDICTION)
+	{
+		d *= P2D_AABB_MAX_PREDICTION / prediction;
+	}
+	else if (prediction > 0.0f && prediction < P2D_AABB_MIN_PREDICTION && node->drift.Length() > jitter)
 	{
-		return false;
+		d *= P2D_AABB_MIN_PREDICTION / prediction;
 	}
 
+	if (node->aabb.Contains(aabb))
+	{
+		// Keep the fat AABB unless it stayed far larger than this motion needs.
+		// The averages of a settling proxy swing around zero, shrinking on the
+		// first quiet move only re-inserts it again on the next bump.
+		float32 slack = node->aabb.GetPerimeter() - aabb.GetPerimeter();
+		float32 needed = 8.0f * margin + 2.0f * (P2DAbs(d.x) + P2DAbs(d.y));
+		if (slack <= P2D_AABB_SHRINK_RATIO * needed)
+		{
+			node->slackMoves = 0;
+			return false;
+		}
+
+		if (++node->slackMoves < P2D_AABB_SHRINK_MOVES)
+		{
+			return false;
+		}
+	}
+
+	node->slackMoves = 0;
 	RemoveLeaf(proxyId);
 
 	// Extend AABB.
 	P2DAABB b = aabb;
-	P2DVec2 r(P2D_AABB_EXTENSION, P2D_AABB_EXTENSION);
+	P2DVec2 r(margin, margin);
 	b.lowerBound = b.lowerBound - r;
 	b.upperBound = b.upperBound + r;
 
-	// Predict AABB displacement.
-	P2DVec2 d = P2D_AABB_MULTIPLIER * displacement;
-
 	if (d.x < 0.0f)
 	{
 		b.lowerBound.x += d.x;
@@ -245,6 +303,7 @@ void P2DBTree::InsertLeaf(int32 leaf)
 	m_nodes[newParent].parent = oldParent;
 	m_nodes[newParent].userData = NULL;
 	m_nodes[newParent].aabb.Combine(leafAABB, m_nodes[sibling].aabb);
+	m_nodes[newParent].filter.Combine(m_nodes[leaf].filter, m_nodes[sibling].filter);
 	m_nodes[newParent].height = m_nodes[sibling].height + 1;
 
 	if (oldParent != NULL_NODE)
@@ -288,6 +347,7 @@ void P2DBTree::InsertLeaf(int32 leaf)
 
 		m_nodes[index].height = 1 + P2DMax(m_nodes[child1].height, m_nodes[child2].height);
 		m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+		m_nodes[index].filter.Combine(m_nodes[child1].filter, m_nodes[child2].filter);
 
 		index = m_nodes[index].parent;
 	}
@@ -339,6 +399,7 @@ void P2DBTree::RemoveLeaf(int32 leaf)
 			int32 child2 = m_nodes[index].child2;
 
 			m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+			m_nodes[index].filter.Combine(m_nodes[child1].filter, m_nodes[child2].filter);
 			m_nodes[index].height = 1 + P2DMax(m_nodes[child1].height, m_nodes[child2].height);
 
 			index = m_nodes[index].parent;
@@ -354,6 +415,57 @@ void P2DBTree::RemoveLeaf(int32 leaf)
 	//Validate();
 }
 
+// Walk down to a leaf, picking children by the bits of m_path. Advancing
+// the path spreads successive walks over the whole tree.
+int32 P2DBTree::GetNextRebalanceLeaf()
+{
+	int32 node = m_root;
+	uint32 bit = 0;
+	while (m_nodes[node].IsLeaf() == false)
+	{
+		uint32 selector = (m_path >> bit) & 1;
+		node = selector == 0 ? m_nodes[node].child1 : m_nodes[node].child2;
+
+		// Keep bit between 0 and 31 because m_path has 32 bits.
+		bit = (bit + 1) & 0x1F;
+	}
+
+	++m_path;
+	return node;
+}
+
+void P2DBTree::Rebalance(int32 iterations)
+{
+	if (m_root == NULL_NODE || m_nodes[m_root].IsLeaf())
+	{
+		return;
+	}
+
+	for (int32 i = 0; i < iterations; ++i)
+	{
+		// The cost of a leaf is how much it grows its parent beyond its sibling.
+		// Re-inserting a badly placed leaf frees that surface area.
+		int32 worst = NULL_NODE;
+		float32 worstCost = 0.0f;
+		for (int32 j = 0; j < P2D_TREE_REBALANCE_SAMPLES; ++j)
+		{
+			int32 leaf = GetNextRebalanceLeaf();
+			int32 parent = m_nodes[leaf].parent;
+			int32 sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+			float32 cost = m_nodes[parent].aabb.GetPerimeter() - m_nodes[sibling].aabb.GetPerimeter();
+			if (worst == NULL_NODE || cost > worstCost)
+			{
+				worst = leaf;
+				worstCost = cost;
+			}
+		}
+
+		RemoveLeaf(worst);
+		InsertLeaf(worst);
+	}
+}
+
 // Perform a left or right rotation if node A is imbalanced.
 // Returns the new root index.
 int32 P2DBTree::Balance(int32 iA)
@@ -416,7 +528,9 @@ int32 P2DBTree::Balance(int32 iA)
 			A->child2 = iG;
 			G->parent = iA;
 			A->aabb.Combine(B->aabb, G->aabb);
+			A->filter.Combine(B->filter, G->filter);
 			C->aabb.Combine(A->aabb, F->aabb);
+			C->filter.Combine(A->filter, F->filter);
 
 			A->height = 1 + P2DMax(B->height, G->height);
 			C->height = 1 + P2DMax(A->height, F->height);
@@ -427,7 +541,9 @@ int32 P2DBTree::Balance(int32 iA)
 			A->child2 = iF;
 			F->parent = iA;
 			A->aabb.Combine(B->aabb, F->aabb);
+			A->filter.Combine(B->filter, F->filter);
 			C->aabb.Combine(A->aabb, G->aabb);
+			C->filter.Combine(A->filter, G->filter);
 
 			A->height = 1 + P2DMax(B->height, F->height);
 			C->height = 1 + P2DMax(A->height, G->height);
@@ -476,7 +592,9 @@ int32 P2DBTree::Balance(int32 iA)
 			A->child1 = iE;
 			E->parent = iA;
 			A->aabb.Combine(C->aabb, E->aabb);
+			A->filter.Combine(C->filter, E->filter);
 			B->aabb.Combine(A->aabb, D->aabb);
+			B->filter.Combine(A->filter, D->filter);
 
 			A->height = 1 + P2DMax(C->height, E->height);
 			B->height = 1 + P2DMax(A->height, D->height);
@@ -487,7 +605,9 @@ int32 P2DBTree::Balance(int32 iA)
 			A->child1 = iD;
 			D->parent = iA;
 			A->aabb.Combine(C->aabb, D->aabb);
+			A->filter.Combine(C->filter, D->filter);
 			B->aabb.Combine(A->aabb, E->aabb);
+			B->filter.Combine(A->filter, E->filter);
 
 			A->height = 1 + P2DMax(C->height, D->height);
 			B->height = 1 + P2DMax(A->height, E->height);
@@ -675,7 +795,7 @@ int32 P2DBTree::GetMaxBalance() const
 
 void P2DBTree::RebuildBottomUp()
 {
-	int32* nodes = (int32*)MemAlloc(m_nodeCount * sizeof(int32));
+	int32* nodes = (int32*)MemAlloc(m_nodeCount * sizeof(int32), e_memTreeNodes);
 	int32 count = 0;
 
 	// Build array of leaves. Free the rest.
@@ -733,6 +853,7 @@ void P2DBTree::RebuildBottomUp()
 		parent->child2 = index2;
 		parent->height = 1 + P2DMax(child1->height, child2->height);
 		parent->aabb.Combine(child1->aabb, child2->aabb);
+		parent->filter.Combine(child1->filter, child2->filter);
 		parent->parent = NULL_NODE;
 
 		child1->parent = parentIndex;
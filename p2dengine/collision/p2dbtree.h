@@ -6,6 +6,43 @@
 
 #define NULL_NODE (-1)
 
+/// Collision filter data of a proxy, see P2DContactFilterData.
+/// For an internal node categoryBits and layerBits are the union of its
+/// children, so filtered queries can skip whole subtrees.
+struct P2DProxyFilter
+{
+	void Combine(const P2DProxyFilter& filter1, const P2DProxyFilter& filter2)
+	{
+		categoryBits = filter1.categoryBits | filter2.categoryBits;
+		layerBits = filter1.layerBits | filter2.layerBits;
+		maskBits = 0xFFFF;
+		groupIndex = 0;
+	}
+
+	uint16 categoryBits;
+	uint16 maskBits;
+	int16 groupIndex;
+	uint16 layerBits;	///< one bit per layer, a proxy is on exactly one layer
+};
+
+/// The filter of a proxy that collides with everything on layer 0.
+inline P2DProxyFilter P2DDefaultProxyFilter()
+{
+	P2DProxyFilter filter;
+	filter.categoryBits = 0x0001;
+	filter.maskBits = 0xFFFF;
+	filter.groupIndex = 0;
+	filter.layerBits = 0x0001;
+	return filter;
+}
+
+/// A proxy found by P2DBTree::QueryNearest.
+struct P2DProxyDistance
+{
+	int32 proxyId;
+	float32 distance;
+};
+
 /// A node in the dynamic tree. The client does not interact with this directly.
 struct P2DBTreeNode
 {
@@ -19,6 +56,8 @@ struct P2DBTreeNode
 
 	void* userData;
 
+	P2DProxyFilter filter;
+
 	union
 	{
 		int32 parent;
@@ -30,6 +69,14 @@ struct P2DBTreeNode
 
 	// leaf = 0, free node = -1
 	int32 height;
+
+	// The average displacement of a leaf per move and the average distance
+	// it moves. Their difference is the jitter of the leaf.
+	P2DVec2 drift;
+	float32 motion;
+
+	// The number of moves in a row the fat AABB of a leaf was larger than needed.
+	int32 slackMoves;
 };
 
 /// A dynamic AABB tree broad-phase, inspired by Nathanael Presson's btDbvt.
@@ -50,7 +97,7 @@ public:
 	~P2DBTree();
 
 	/// Create a proxy. Provide a tight fitting AABB and a userData pointer.
-	int32 CreateProxy(const P2DAABB& aabb, void* userData);
+	int32 CreateProxy(const P2DAABB& aabb, void* userData, const P2DProxyFilter& filter = P2DDefaultProxyFilter());
 
 	/// Destroy a proxy. This asserts if the id is invalid.
 	void DestroyProxy(int32 proxyId);
@@ -58,8 +105,13 @@ public:
 	/// Move a proxy with a swepted AABB. If the proxy has moved outside of its fattened AABB,
 	/// then the proxy is removed from the tree and re-inserted. Otherwise
 	/// the function returns immediately.
+	/// The margin of the new fattened AABB follows the average displacement of
+	/// the proxy. A proxy whose fattened AABB stayed much larger than it needs
+	/// for P2D_AABB_SHRINK_MOVES moves is re-inserted as well.
+	/// @param teleport the proxy was placed rather than moved, the displacement
+	/// is ignored and does not change the average motion.
 	/// @return true if the proxy was re-inserted.
-	bool MoveProxy(int32 proxyId, const P2DAABB& aabb1, const P2DVec2& displacement);
+	bool MoveProxy(int32 proxyId, const P2DAABB& aabb1, const P2DVec2& displacement, bool teleport = false);
 
 	/// Get proxy user data.
 	/// @return the proxy user data or 0 if the id is invalid.
@@ -68,11 +120,24 @@ public:
 	/// Get the fat AABB for a proxy.
 	const P2DAABB& GetFatAABB(int32 proxyId) const;
 
+	/// Set the collision filter of a proxy. This updates the filter unions of
+	/// its ancestors.
+	void SetFilter(int32 proxyId, const P2DProxyFilter& filter);
+
+	/// Get the collision filter of a proxy.
+	const P2DProxyFilter& GetFilter(int32 proxyId) const;
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
 	template <typename T>
 	void Query(T* callback, const P2DAABB& aabb) const;
 
+	/// Query an AABB for overlapping proxies that have a category bit in
+	/// categoryMask and a layer bit in layerMask. Subtrees without such a
+	/// proxy are skipped.
+	template <typename T>
+	void Query(T* callback, const P2DAABB& aabb, uint16 categoryMask, uint16 layerMask) const;
+
 	/// Ray-cast against the proxies in the tree. This relies on the callback
 	/// to perform a exact ray-cast in the case were the proxy contains a shape.
 	/// The callback also performs the any collision filtering. This has performance
@@ -83,6 +148,37 @@ public:
 	template <typename T>
     void RayCast(T* callback, const P2DRayCastInput& input) const;
 
+	/// Ray-cast a packet of up to P2D_RAY_PACKET_SIZE rays against the proxies in
+	/// the tree in one traversal. A node is visited once for the whole packet and
+	/// tested against every ray with a slab test. Coherent rays (e.g. a fan from
+	/// one point) share most of the visited nodes.
+	/// The callback is called as callback->RayCastCallback(rayIndex, input, proxyId)
+	/// for each ray whose segment overlaps a proxy and returns like RayCast.
+	template <typename T>
+	void RayCastPacket(T* callback, const P2DRayCastInput* inputs, int32 count) const;
+
+	/// Sweep an AABB through the tree. Each node is grown by the extents of the
+	/// AABB and tested against the path of its center, so only nodes the moving
+	/// box can touch are visited. The callback is called as
+	/// callback->ShapeCastCallback(proxyId, maxFraction) and returns like RayCast:
+	/// 0 terminates the cast, a fraction clips the path and -1 ignores the proxy.
+	/// @param translation the path of the box, may be zero.
+	/// @param maxFraction the part of the path to search.
+	template <typename T>
+	void ShapeCast(T* callback, const P2DAABB& aabb, const P2DVec2& translation, float32 maxFraction) const;
+
+	/// Find the proxies closest to a point with a branch and bound search.
+	/// Children are visited nearest first and a subtree is skipped once its
+	/// AABB is farther away than the k-th best distance found so far.
+	/// The callback is called as callback->NearestCallback(proxyId, point, maxDistance)
+	/// and returns the exact distance of the proxy, or a negative value to skip it.
+	/// @param maxDistance the search radius. Use FLT_MAX for a plain k nearest search.
+	/// @param results receives up to k proxies, sorted by increasing distance.
+	/// @return the number of proxies found.
+	template <typename T>
+	int32 QueryNearest(T* callback, const P2DVec2& point, float32 maxDistance,
+					   P2DProxyDistance* results, int32 k) const;
+
 	/// Validate this tree. For testing.
 	void Validate() const;
 
@@ -100,6 +196,12 @@ public:
 	/// Build an optimal tree. Very expensive. For testing.
 	void RebuildBottomUp();
 
+	/// Incrementally improve the tree. Each iteration samples
+	/// P2D_TREE_REBALANCE_SAMPLES leaves along a path that sweeps the tree over
+	/// successive calls and re-inserts the one that inflates its parent the most.
+	/// Fat AABBs don't change, so this creates no new pairs.
+	void Rebalance(int32 iterations);
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
@@ -115,6 +217,8 @@ private:
 
 	int32 Balance(int32 index);
 
+	int32 GetNextRebalanceLeaf();
+
 	int32 ComputeHeight() const;
 	int32 ComputeHeight(int32 nodeId) const;
 
@@ -147,6 +251,12 @@ inline const P2DAABB& P2DBTree::GetFatAABB(int32 proxyId) const
 	return m_nodes[proxyId].aabb;
 }
 
+inline const P2DProxyFilter& P2DBTree::GetFilter(int32 proxyId) const
+{
+	assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	return m_nodes[proxyId].filter;
+}
+
 template <typename T>
 inline void P2DBTree::Query(T* callback, const P2DAABB& aabb) const
 {
@@ -182,6 +292,46 @@ inline void P2DBTree::Query(T* callback, const P2DAABB& aabb) const
 	}
 }
 
+template <typename T>
+inline void P2DBTree::Query(T* callback, const P2DAABB& aabb, uint16 categoryMask, uint16 layerMask) const
+{
+	P2DGrowableStack<int32, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int32 nodeId = stack.Pop();
+		if (nodeId == NULL_NODE)
+		{
+			continue;
+		}
+
+		const P2DBTreeNode* node = m_nodes + nodeId;
+
+		if ((node->filter.categoryBits & categoryMask) == 0 || (node->filter.layerBits & layerMask) == 0)
+		{
+			continue;
+		}
+
+		if (P2DTestOverlap(node->aabb, aabb))
+		{
+			if (node->IsLeaf())
+			{
+				bool proceed = callback->QueryCallback(nodeId);
+				if (proceed == false)
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.Push(node->child1);
+				stack.Push(node->child2);
+			}
+		}
+	}
+}
+
 template <typename T>
 inline void P2DBTree::RayCast(T* callback, const P2DRayCastInput &input) const
 {
@@ -268,4 +418,267 @@ inline void P2DBTree::RayCast(T* callback, const P2DRayCastInput &input) const
 	}
 }
 
+template <typename T>
+inline void P2DBTree::RayCastPacket(T* callback, const P2DRayCastInput* inputs, int32 count) const
+{
+	assert(0 < count && count <= P2D_RAY_PACKET_SIZE);
+
+	// The rays in structure of arrays form, so the per node loop over the
+	// packet compiles to straight line code that the compiler can vectorize.
+	// A ray is p1 + t * (p2 - p1) with t in [0, maxFraction].
+	float32 originX[P2D_RAY_PACKET_SIZE];
+	float32 originY[P2D_RAY_PACKET_SIZE];
+	float32 invDeltaX[P2D_RAY_PACKET_SIZE];
+	float32 invDeltaY[P2D_RAY_PACKET_SIZE];
+	float32 maxFraction[P2D_RAY_PACKET_SIZE];
+	int32 hits[P2D_RAY_PACKET_SIZE];
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		P2DVec2 d = inputs[i].p2 - inputs[i].p1;
+		assert(d.LengthSquared() > 0.0f);
+		originX[i] = inputs[i].p1.x;
+		originY[i] = inputs[i].p1.y;
+
+		// An axis parallel ray gets a huge inverse so the slab test stays NaN free.
+		invDeltaX[i] = d.x != 0.0f ? 1.0f / d.x : FLT_MAX;
+		invDeltaY[i] = d.y != 0.0f ? 1.0f / d.y : FLT_MAX;
+		maxFraction[i] = inputs[i].maxFraction;
+	}
+
+	P2DGrowableStack<int32, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int32 nodeId = stack.Pop();
+		if (nodeId == NULL_NODE)
+		{
+			continue;
+		}
+
+		const P2DBTreeNode* node = m_nodes + nodeId;
+		P2DVec2 lower = node->aabb.lowerBound;
+		P2DVec2 upper = node->aabb.upperBound;
+
+		// Slab test of every ray against the node. A terminated ray has a
+		// negative max fraction and never hits.
+		int32 hitCount = 0;
+		for (int32 i = 0; i < count; ++i)
+		{
+			float32 tx1 = (lower.x - originX[i]) * invDeltaX[i];
+			float32 tx2 = (upper.x - originX[i]) * invDeltaX[i];
+			float32 ty1 = (lower.y - originY[i]) * invDeltaY[i];
+			float32 ty2 = (upper.y - originY[i]) * invDeltaY[i];
+
+			float32 tmin = P2DMax(P2DMax(P2DMin(tx1, tx2), P2DMin(ty1, ty2)), 0.0f);
+			float32 tmax = P2DMin(P2DMin(P2DMax(tx1, tx2), P2DMax(ty1, ty2)), maxFraction[i]);
+
+			hits[i] = tmin <= tmax ? 1 : 0;
+			hitCount += hits[i];
+		}
+
+		if (hitCount == 0)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf())
+		{
+			for (int32 i = 0; i < count; ++i)
+			{
+				if (hits[i] == 0)
+				{
+					continue;
+				}
+
+				P2DRayCastInput subInput;
+				subInput.p1 = inputs[i].p1;
+				subInput.p2 = inputs[i].p2;
+				subInput.maxFraction = maxFraction[i];
+
+				float32 value = callback->RayCastCallback(i, subInput, nodeId);
+
+				if (value == 0.0f)
+				{
+					// The client has terminated this ray.
+					maxFraction[i] = -1.0f;
+				}
+				else if (value > 0.0f)
+				{
+					// Clip the ray.
+					maxFraction[i] = value;
+				}
+			}
+		}
+		else
+		{
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+		}
+	}
+}
+
+template <typename T>
+inline void P2DBTree::ShapeCast(T* callback, const P2DAABB& aabb, const P2DVec2& translation, float32 maxFraction) const
+{
+	P2DVec2 origin = aabb.GetCenter();
+	P2DVec2 extents = aabb.GetExtents();
+
+	// A zero component gets a huge inverse, so the slab test stays NaN free
+	// and a box that doesn't move becomes an overlap test.
+	float32 invDeltaX = translation.x != 0.0f ? 1.0f / translation.x : FLT_MAX;
+	float32 invDeltaY = translation.y != 0.0f ? 1.0f / translation.y : FLT_MAX;
+
+	P2DGrowableStack<int32, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int32 nodeId = stack.Pop();
+		if (nodeId == NULL_NODE)
+		{
+			continue;
+		}
+
+		const P2DBTreeNode* node = m_nodes + nodeId;
+		P2DVec2 lower = node->aabb.lowerBound - extents;
+		P2DVec2 upper = node->aabb.upperBound + extents;
+
+		float32 tx1 = (lower.x - origin.x) * invDeltaX;
+		float32 tx2 = (upper.x - origin.x) * invDeltaX;
+		float32 ty1 = (lower.y - origin.y) * invDeltaY;
+		float32 ty2 = (upper.y - origin.y) * invDeltaY;
+
+		float32 tmin = P2DMax(P2DMax(P2DMin(tx1, tx2), P2DMin(ty1, ty2)), 0.0f);
+		float32 tmax = P2DMin(P2DMin(P2DMax(tx1, tx2), P2DMax(ty1, ty2)), maxFraction);
+		if (tmin > tmax)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf())
+		{
+			float32 value = callback->ShapeCastCallback(nodeId, maxFraction);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Clip the path.
+				maxFraction = value;
+			}
+		}
+		else
+		{
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+		}
+	}
+}
+
+// The squared distance from a point to an AABB, zero inside it.
+inline float32 P2DDistanceSquared(const P2DAABB& aabb, const P2DVec2& point)
+{
+	float32 dx = P2DMax(P2DMax(aabb.lowerBound.x - point.x, point.x - aabb.upperBound.x), 0.0f);
+	float32 dy = P2DMax(P2DMax(aabb.lowerBound.y - point.y, point.y - aabb.upperBound.y), 0.0f);
+	return dx * dx + dy * dy;
+}
+
+template <typename T>
+inline int32 P2DBTree::QueryNearest(T* callback, const P2DVec2& point, float32 maxDistance,
+									P2DProxyDistance* results, int32 k) const
+{
+	assert(k > 0);
+	assert(maxDistance >= 0.0f);
+
+	int32 count = 0;
+	if (m_root == NULL_NODE)
+	{
+		return 0;
+	}
+
+	// The search radius shrinks to the k-th best distance once k proxies are found.
+	float32 bound = maxDistance;
+	float32 boundSquared = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+
+	// Nodes are pushed with the squared distance of their AABB so a node can
+	// be dropped when popped if the bound has shrunk past it in the meantime.
+	P2DProxyDistance entry;
+	entry.proxyId = m_root;
+	entry.distance = P2DDistanceSquared(m_nodes[m_root].aabb, point);
+
+	P2DGrowableStack<P2DProxyDistance, 256> stack;
+	stack.Push(entry);
+
+	while (stack.GetCount() > 0)
+	{
+		entry = stack.Pop();
+		if (entry.distance > boundSquared)
+		{
+			continue;
+		}
+
+		int32 nodeId = entry.proxyId;
+		const P2DBTreeNode* node = m_nodes + nodeId;
+
+		if (node->IsLeaf())
+		{
+			float32 distance = callback->NearestCallback(nodeId, point, bound);
+			if (distance < 0.0f || distance > bound || (count == k && distance >= bound))
+			{
+				continue;
+			}
+
+			// Insertion sort, k is expected to be small.
+			int32 i = count < k ? count++ : k - 1;
+			while (i > 0 && results[i - 1].distance > distance)
+			{
+				results[i] = results[i - 1];
+				--i;
+			}
+
+			results[i].proxyId = nodeId;
+			results[i].distance = distance;
+
+			if (count == k)
+			{
+				bound = results[k - 1].distance;
+				boundSquared = bound * bound;
+			}
+		}
+		else
+		{
+			P2DProxyDistance entry1, entry2;
+			entry1.proxyId = node->child1;
+			entry1.distance = P2DDistanceSquared(m_nodes[node->child1].aabb, point);
+			entry2.proxyId = node->child2;
+			entry2.distance = P2DDistanceSquared(m_nodes[node->child2].aabb, point);
+
+			// Push the farther child first so the nearer one is visited first
+			// and tightens the bound early.
+			if (entry1.distance < entry2.distance)
+			{
+				P2DSwap(entry1, entry2);
+			}
+
+			if (entry1.distance <= boundSquared)
+			{
+				stack.Push(entry1);
+			}
+
+			if (entry2.distance <= boundSquared)
+			{
+				stack.Push(entry2);
+			}
+		}
+	}
+
+	return count;
+}
+
 #endif
@@ -3,14 +3,22 @@
 P2DCoarseCollision::P2DCoarseCollision()
 {
 	m_proxyCount = 0;
+	m_reinsertCount = 0;
+	m_rebalanceBudget = P2D_TREE_REBALANCE_BUDGET;
 
 	m_pairCapacity = 16;
 	m_pairCount = 0;
-	m_pairBuffer = (P2DPair*)MemAlloc(m_pairCapacity * sizeof(P2DPair));
+	m_pairBuffer = (P2DPair*)MemAlloc(m_pairCapacity * sizeof(P2DPair), e_memPairBuffer);
 
 	m_moveCapacity = 16;
 	m_moveCount = 0;
-	m_moveBuffer = (int32*)MemAlloc(m_moveCapacity * sizeof(int32));
+	m_moveBuffer = (int32*)MemAlloc(m_moveCapacity * sizeof(int32), e_memPairBuffer);
+
+	m_queryLayerMask = 0xFFFF;
+	for (int32 i = 0; i < P2D_MAX_LAYERS; ++i)
+	{
+		m_layerMasks[i] = 0xFFFF;
+	}
 }
 
 P2DCoarseCollision::~P2DCoarseCollision()
@@ -19,9 +27,9 @@ P2DCoarseCollision::~P2DCoarseCollision()
 	MemFree(m_pairBuffer);
 }
 
-int32 P2DCoarseCollision::CreateProxy(const P2DAABB& aabb, void* userData)
+int32 P2DCoarseCollision::CreateProxy(const P2DAABB& aabb, void* userData, const P2DProxyFilter& filter)
 {
-	int32 proxyId = m_tree.CreateProxy(aabb, userData);
+	int32 proxyId = m_tree.CreateProxy(aabb, userData, filter);
 	++m_proxyCount;
 	BufferMove(proxyId);
 	return proxyId;
@@ -34,11 +42,12 @@ void P2DCoarseCollision::DestroyProxy(int32 proxyId)
 	m_tree.DestroyProxy(proxyId);
 }
 
-void P2DCoarseCollision::MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement)
+void P2DCoarseCollision::MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement, bool teleport)
 {
-	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement, teleport);
 	if (buffer)
 	{
+		++m_reinsertCount;
 		BufferMove(proxyId);
 	}
 }
@@ -48,13 +57,35 @@ void P2DCoarseCollision::TouchProxy(int32 proxyId)
 	BufferMove(proxyId);
 }
 
+void P2DCoarseCollision::SetProxyFilter(int32 proxyId, const P2DProxyFilter& filter)
+{
+	m_tree.SetFilter(proxyId, filter);
+}
+
+void P2DCoarseCollision::SetLayerCollision(int32 layerA, int32 layerB, bool flag)
+{
+	assert(0 <= layerA && layerA < P2D_MAX_LAYERS);
+	assert(0 <= layerB && layerB < P2D_MAX_LAYERS);
+
+	if (flag)
+	{
+		m_layerMasks[layerA] |= (uint16)(1 << layerB);
+		m_layerMasks[layerB] |= (uint16)(1 << layerA);
+	}
+	else
+	{
+		m_layerMasks[layerA] &= (uint16)~(1 << layerB);
+		m_layerMasks[layerB] &= (uint16)~(1 << layerA);
+	}
+}
+
 void P2DCoarseCollision::BufferMove(int32 proxyId)
 {
 	if (m_moveCount == m_moveCapacity)
 	{
 		int32* oldBuffer = m_moveBuffer;
 		m_moveCapacity *= 2;
-		m_moveBuffer = (int32*)MemAlloc(m_moveCapacity * sizeof(int32));
+		m_moveBuffer = (int32*)MemAlloc(m_moveCapacity * sizeof(int32), e_memPairBuffer);
 		memcpy(m_moveBuffer, oldBuffer, m_moveCount * sizeof(int32));
 		MemFree(oldBuffer);
 	}
@@ -83,12 +114,18 @@ bool P2DCoarseCollision::QueryCallback(int32 proxyId)
 		return true;
 	}
 
+	// The tree only pruned by category and layer, apply the full test.
+	if (ShouldPair(m_queryFilter, m_tree.GetFilter(proxyId), m_queryLayerMask) == false)
+	{
+		return true;
+	}
+
 	// Grow the pair buffer as needed.
 	if (m_pairCount == m_pairCapacity)
 	{
 		P2DPair* oldBuffer = m_pairBuffer;
 		m_pairCapacity *= 2;
-        m_pairBuffer = (P2DPair*)MemAlloc(m_pairCapacity * sizeof(P2DPair));
+        m_pairBuffer = (P2DPair*)MemAlloc(m_pairCapacity * sizeof(P2DPair), e_memPairBuffer);
         memcpy(m_pairBuffer, oldBuffer, m_pairCount * sizeof(P2DPair));
 		MemFree(oldBuffer);
 	}
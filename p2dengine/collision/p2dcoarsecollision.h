@@ -15,6 +15,8 @@ struct P2DPair
 /// The coarse collision is used for computing pairs and performing volume queries and ray casts.
 /// This coarse collision does not persist pairs. Instead, this reports potentially new pairs.
 /// It is up to the client to consume the new pairs and to track subsequent overlap.
+/// Pairs are filtered by the proxy filters and the layer collision matrix
+/// before they are reported, see ShouldPair.
 class P2DCoarseCollision
 {
 public:
@@ -29,14 +31,15 @@ public:
 
 	/// Create a proxy with an initial AABB. Pairs are not reported until
 	/// UpdatePairs is called.
-	int32 CreateProxy(const P2DAABB& aabb, void* userData);
+	int32 CreateProxy(const P2DAABB& aabb, void* userData, const P2DProxyFilter& filter = P2DDefaultProxyFilter());
 
 	/// Destroy a proxy. It is up to the client to remove any pairs.
 	void DestroyProxy(int32 proxyId);
 
 	/// Call MoveProxy as many times as you like, then when you are done
 	/// call UpdatePairs to finalized the proxy pairs (for your time step).
-	void MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement);
+	/// Pass teleport for a proxy that was placed rather than moved, see P2DBTree::MoveProxy.
+	void MoveProxy(int32 proxyId, const P2DAABB& aabb, const P2DVec2& displacement, bool teleport = false);
 
 	/// Call to trigger a re-processing of it's pairs on the next call to UpdatePairs.
 	void TouchProxy(int32 proxyId);
@@ -53,6 +56,31 @@ public:
 	/// Get the number of proxies.
 	int32 GetProxyCount() const;
 
+	/// Get the number of proxies re-inserted into the tree by MoveProxy
+	/// since the last ResetReinsertCount.
+	int32 GetReinsertCount() const;
+
+	/// Reset the re-insertion counter.
+	void ResetReinsertCount();
+
+	/// Change the filter of a proxy. Call TouchProxy to pick up new pairs.
+	void SetProxyFilter(int32 proxyId, const P2DProxyFilter& filter);
+
+	/// Get the filter of a proxy.
+	const P2DProxyFilter& GetProxyFilter(int32 proxyId) const;
+
+	/// Enable or disable collision between two layers. Layers collide with
+	/// every layer by default. Touch the proxies to pick up new pairs.
+	void SetLayerCollision(int32 layerA, int32 layerB, bool flag);
+
+	/// Do two layers collide?
+	bool GetLayerCollision(int32 layerA, int32 layerB) const;
+
+	/// Test whether two proxies may form a pair. This applies the layer matrix,
+	/// then the group index and the category/mask bits the same way the default
+	/// P2DContactFilter does. A custom contact filter can only reject more pairs.
+	bool ShouldPair(int32 proxyIdA, int32 proxyIdB) const;
+
 	/// Update the pairs. This results in pair callbacks. This can only add pairs.
 	template <typename T>
 	void UpdatePairs(T* callback);
@@ -72,6 +100,19 @@ public:
 	template <typename T>
     void RayCast(T* callback, const P2DRayCastInput& input) const;
 
+	/// Ray-cast a packet of up to P2D_RAY_PACKET_SIZE rays, see P2DBTree::RayCastPacket.
+	template <typename T>
+	void RayCastPacket(T* callback, const P2DRayCastInput* inputs, int32 count) const;
+
+	/// Sweep an AABB through the tree, see P2DBTree::ShapeCast.
+	template <typename T>
+	void ShapeCast(T* callback, const P2DAABB& aabb, const P2DVec2& translation, float32 maxFraction) const;
+
+	/// Find the proxies closest to a point, see P2DBTree::QueryNearest.
+	template <typename T>
+	int32 QueryNearest(T* callback, const P2DVec2& point, float32 maxDistance,
+					   P2DProxyDistance* results, int32 k) const;
+
 	/// Get the height of the embedded tree.
 	int32 GetTreeHeight() const;
 
@@ -81,6 +122,14 @@ public:
 	/// Get the quality metric of the embedded tree.
 	float32 GetTreeQuality() const;
 
+	/// Re-insert a budget of tree leaves to keep the tree balanced. The scene
+	/// calls this once per time step.
+	void Rebalance();
+
+	/// Set the number of tree leaves re-inserted by Rebalance.
+	void SetRebalanceBudget(int32 leafCount);
+	int32 GetRebalanceBudget() const;
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
@@ -93,11 +142,15 @@ private:
 	void BufferMove(int32 proxyId);
 	void UnBufferMove(int32 proxyId);
 
+	uint16 GetLayerMask(uint16 layerBits) const;
+	bool ShouldPair(const P2DProxyFilter& filterA, const P2DProxyFilter& filterB, uint16 layerMaskA) const;
+
 	bool QueryCallback(int32 proxyId);
 
 	P2DBTree m_tree;
 
 	int32 m_proxyCount;
+	int32 m_reinsertCount;
 
 	int32* m_moveBuffer;
 	int32 m_moveCapacity;
@@ -108,6 +161,12 @@ private:
 	int32 m_pairCount;
 
 	int32 m_queryProxyId;
+	int32 m_rebalanceBudget;
+	P2DProxyFilter m_queryFilter;
+	uint16 m_queryLayerMask;
+
+	// Row i holds the layers that layer i collides with.
+	uint16 m_layerMasks[P2D_MAX_LAYERS];
 };
 
 /// This is used to sort pairs.
@@ -148,6 +207,63 @@ inline int32 P2DCoarseCollision::GetProxyCount() const
 	return m_proxyCount;
 }
 
+inline int32 P2DCoarseCollision::GetReinsertCount() const
+{
+	return m_reinsertCount;
+}
+
+inline void P2DCoarseCollision::ResetReinsertCount()
+{
+	m_reinsertCount = 0;
+}
+
+inline const P2DProxyFilter& P2DCoarseCollision::GetProxyFilter(int32 proxyId) const
+{
+	return m_tree.GetFilter(proxyId);
+}
+
+inline bool P2DCoarseCollision::GetLayerCollision(int32 layerA, int32 layerB) const
+{
+	assert(0 <= layerA && layerA < P2D_MAX_LAYERS);
+	assert(0 <= layerB && layerB < P2D_MAX_LAYERS);
+	return (m_layerMasks[layerA] & (1 << layerB)) != 0;
+}
+
+inline uint16 P2DCoarseCollision::GetLayerMask(uint16 layerBits) const
+{
+	uint16 mask = 0;
+	for (int32 i = 0; i < P2D_MAX_LAYERS; ++i)
+	{
+		if (layerBits & (1 << i))
+		{
+			mask |= m_layerMasks[i];
+		}
+	}
+	return mask;
+}
+
+inline bool P2DCoarseCollision::ShouldPair(const P2DProxyFilter& filterA, const P2DProxyFilter& filterB, uint16 layerMaskA) const
+{
+	if ((layerMaskA & filterB.layerBits) == 0)
+	{
+		return false;
+	}
+
+	if (filterA.groupIndex == filterB.groupIndex && filterA.groupIndex != 0)
+	{
+		return filterA.groupIndex > 0;
+	}
+
+	return (filterA.maskBits & filterB.categoryBits) != 0 && (filterA.categoryBits & filterB.maskBits) != 0;
+}
+
+inline bool P2DCoarseCollision::ShouldPair(int32 proxyIdA, int32 proxyIdB) const
+{
+	const P2DProxyFilter& filterA = m_tree.GetFilter(proxyIdA);
+	const P2DProxyFilter& filterB = m_tree.GetFilter(proxyIdB);
+	return ShouldPair(filterA, filterB, GetLayerMask(filterA.layerBits));
+}
+
 inline int32 P2DCoarseCollision::GetTreeHeight() const
 {
 	return m_tree.GetHeight();
@@ -163,6 +279,22 @@ inline float32 P2DCoarseCollision::GetTreeQuality() const
 	return m_tree.GetAreaRatio();
 }
 
+inline void P2DCoarseCollision::SetRebalanceBudget(int32 leafCount)
+{
+	assert(leafCount >= 0);
+	m_rebalanceBudget = leafCount;
+}
+
+inline void P2DCoarseCollision::Rebalance()
+{
+	m_tree.Rebalance(m_rebalanceBudget);
+}
+
+inline int32 P2DCoarseCollision::GetRebalanceBudget() const
+{
+	return m_rebalanceBudget;
+}
+
 template <typename T>
 void P2DCoarseCollision::UpdatePairs(T* callback)
 {
@@ -182,8 +314,14 @@ void P2DCoarseCollision::UpdatePairs(T* callback)
 		// we don't fail to create a pair that may touch later.
 		const P2DAABB& fatAABB = m_tree.GetFatAABB(m_queryProxyId);
 
+		// Skip the subtrees that hold no category this proxy accepts and no
+		// layer it collides with. A positive group can override the mask.
+		m_queryFilter = m_tree.GetFilter(m_queryProxyId);
+		m_queryLayerMask = GetLayerMask(m_queryFilter.layerBits);
+		uint16 categoryMask = m_queryFilter.groupIndex > 0 ? 0xFFFF : m_queryFilter.maskBits;
+
 		// Query tree, create pairs and add them pair buffer.
-		m_tree.Query(this, fatAABB);
+		m_tree.Query(this, fatAABB, categoryMask, m_queryLayerMask);
 	}
 
 	// Reset move buffer
@@ -215,8 +353,6 @@ void P2DCoarseCollision::UpdatePairs(T* callback)
 		}
 	}
 
-	// Try to keep the tree balanced.
-	//m_tree.Rebalance(4);
 }
 
 template <typename T>
@@ -231,6 +367,25 @@ inline void P2DCoarseCollision::RayCast(T* callback, const P2DRayCastInput& inpu
 	m_tree.RayCast(callback, input);
 }
 
+template <typename T>
+inline void P2DCoarseCollision::RayCastPacket(T* callback, const P2DRayCastInput* inputs, int32 count) const
+{
+	m_tree.RayCastPacket(callback, inputs, count);
+}
+
+template <typename T>
+inline void P2DCoarseCollision::ShapeCast(T* callback, const P2DAABB& aabb, const P2DVec2& translation, float32 maxFraction) const
+{
+	m_tree.ShapeCast(callback, aabb, translation, maxFraction);
+}
+
+template <typename T>
+inline int32 P2DCoarseCollision::QueryNearest(T* callback, const P2DVec2& point, float32 maxDistance,
+											  P2DProxyDistance* results, int32 k) const
+{
+	return m_tree.QueryNearest(callback, point, maxDistance, results, k);
+}
+
 inline void P2DCoarseCollision::ShiftOrigin(const P2DVec2& newOrigin)
 {
 	m_tree.ShiftOrigin(newOrigin);
@@ -11,6 +11,7 @@
 
 #include "p2dcollision.h"
 #include "p2dtoi.h"
+#include "p2dimpulsecache.h"
 #include "../objects/p2dbaseobject.h"
 #include "../general/p2dmem.h"
 #include "../scene/p2dbody.h"
@@ -50,7 +51,7 @@ void P2DContact::AddType(P2DContactCreateFcn* createFcn, P2DContactDestroyFcn* d
 	}
 }
 
-P2DContact* P2DContact::Create(P2DFixture* fixtureA, int32 indexA, P2DFixture* fixtureB, int32 indexB, P2DBlockMem* allocator)
+P2DContact* P2DContact::Create(P2DFixture* fixtureA, int32 indexA, P2DFixture* fixtureB, int32 indexB, P2DPool* allocator)
 {
 	if (s_initialized == false)
 	{
@@ -82,7 +83,7 @@ P2DContact* P2DContact::Create(P2DFixture* fixtureA, int32 indexA, P2DFixture* f
 	}
 }
 
-void P2DContact::Destroy(P2DContact* contact, P2DBlockMem* allocator)
+void P2DContact::Destroy(P2DContact* contact, P2DPool* allocator)
 {
 	assert(s_initialized == true);
 
@@ -107,6 +108,20 @@ void P2DContact::Destroy(P2DContact* contact, P2DBlockMem* allocator)
 	destroyFcn(contact, allocator);
 }
 
+P2DContact* P2DContact::GetNext()
+{
+	const P2DContactManager* cm = &m_fixtureA->GetBody()->GetWorld()->m_contactManager;
+	int32 next = m_arrayIndex + 1;
+	return next < cm->m_contactCount ? cm->m_contacts[next] : NULL;
+}
+
+const P2DContact* P2DContact::GetNext() const
+{
+	const P2DContactManager* cm = &m_fixtureA->GetBody()->GetWorld()->m_contactManager;
+	int32 next = m_arrayIndex + 1;
+	return next < cm->m_contactCount ? cm->m_contacts[next] : NULL;
+}
+
 P2DContact::P2DContact(P2DFixture* fA, int32 indexA, P2DFixture* fB, int32 indexB)
 {
 	m_flags = e_enabledFlag;
@@ -119,8 +134,7 @@ P2DContact::P2DContact(P2DFixture* fA, int32 indexA, P2DFixture* fB, int32 index
 
 	m_manifold.pointCount = 0;
 
-	m_prev = NULL;
-	m_next = NULL;
+	m_arrayIndex = -1;
 
 	m_nodeA.contact = NULL;
 	m_nodeA.prev = NULL;
@@ -133,6 +147,7 @@ P2DContact::P2DContact(P2DFixture* fA, int32 indexA, P2DFixture* fB, int32 index
 	m_nodeB.other = NULL;
 
 	m_toiCount = 0;
+	m_toiCache.count = 0;
 
 	m_friction = P2DMixFriction(m_fixtureA->m_friction, m_fixtureB->m_friction);
 	m_restitution = P2DMixRestitution(m_fixtureA->m_restitution, m_fixtureB->m_restitution);
@@ -142,7 +157,7 @@ P2DContact::P2DContact(P2DFixture* fA, int32 indexA, P2DFixture* fB, int32 index
 
 // Update the contact manifold and touching status.
 // Note: do not assume the fixture AABBs are overlapping or are valid.
-void P2DContact::Update(P2DContactListener* listener)
+void P2DContact::Update(P2DContactListener* listener, P2DImpulseCache* cache)
 {
 	P2DManifold oldManifold = m_manifold;
 
@@ -178,6 +193,7 @@ void P2DContact::Update(P2DContactListener* listener)
 
 		// Match old contact ids to new contact ids and copy the
 		// stored impulses to warm start the solver.
+		bool matched[P2D_MAX_MANIFOLD_POINTS] = { false };
 		for (int32 i = 0; i < m_manifold.pointCount; ++i)
 		{
 			P2DManifoldPoint* mp2 = m_manifold.points + i;
@@ -185,6 +201,7 @@ void P2DContact::Update(P2DContactListener* listener)
 			mp2->tangentImpulse = 0.0f;
 			P2DContactID id2 = mp2->id;
 
+			bool found = false;
 			for (int32 j = 0; j < oldManifold.pointCount; ++j)
 			{
 				P2DManifoldPoint* mp1 = oldManifold.points + j;
@@ -193,9 +210,29 @@ void P2DContact::Update(P2DContactListener* listener)
 				{
 					mp2->normalImpulse = mp1->normalImpulse;
 					mp2->tangentImpulse = mp1->tangentImpulse;
+					matched[j] = true;
+					found = true;
 					break;
 				}
 			}
+
+			// A point that was lost recently may still have its impulses cached.
+			if (found == false && cache)
+			{
+				cache->Fetch(m_fixtureA, m_indexA, m_fixtureB, m_indexB, mp2);
+			}
+		}
+
+		// Keep the impulses of the points that went away for a few steps.
+		if (cache)
+		{
+			for (int32 j = 0; j < oldManifold.pointCount; ++j)
+			{
+				if (matched[j] == false)
+				{
+					cache->Store(m_fixtureA, m_indexA, m_fixtureB, m_indexB, oldManifold.points[j]);
+				}
+			}
 		}
 
 		if (touching != wasTouching)
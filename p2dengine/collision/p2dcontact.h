@@ -3,6 +3,7 @@
 
 #include "../general/p2dmath.h"
 #include "p2dcollision.h"
+#include "p2ddistance.h"
 #include "../objects/p2dbaseobject.h"
 #include "../scene/p2dfixture.h"
 
@@ -10,9 +11,10 @@ class P2DBody;
 class P2DContact;
 class P2DFixture;
 class P2DScene;
-class P2DBlockMem;
+class P2DPool;
 class P2DStackMem;
 class P2DContactListener;
+class P2DImpulseCache;
 
 /// Friction mixing law. The idea is to allow either fixture to drive the restitution to zero.
 /// For example, anything slides on ice.
@@ -30,8 +32,8 @@ inline float32 P2DMixRestitution(float32 restitution1, float32 restitution2)
 
 typedef P2DContact* P2DContactCreateFcn(P2DFixture* fixtureA, int32 indexA,
 										P2DFixture* fixtureB, int32 indexB,
-										P2DBlockMem* allocator);
-typedef void P2DContactDestroyFcn(P2DContact* contact, P2DBlockMem* allocator);
+										P2DPool* allocator);
+typedef void P2DContactDestroyFcn(P2DContact* contact, P2DPool* allocator);
 
 struct P2DContactRegister
 {
@@ -79,10 +81,14 @@ public:
 	/// Has this contact been disabled?
 	bool IsEnabled() const;
 
-	/// Get the next contact in the world's contact list.
+	/// Get the next contact in the world's contact array. Destroying a contact
+	/// moves the last contact into its place.
 	P2DContact* GetNext();
 	const P2DContact* GetNext() const;
 
+	/// Get the handle of this contact, see P2DScene::GetContact.
+	P2DHandle GetHandle() const;
+
 	/// Get fixture A in this contact.
 	P2DFixture* GetFixtureA();
 	const P2DFixture* GetFixtureA() const;
@@ -161,24 +167,23 @@ protected:
 	static void AddType(P2DContactCreateFcn* createFcn, P2DContactDestroyFcn* destroyFcn,
 						P2DBaseObject::Type typeA, P2DBaseObject::Type typeB);
 	static void InitializeRegisters();
-	static P2DContact* Create(P2DFixture* fixtureA, int32 indexA, P2DFixture* fixtureB, int32 indexB, P2DBlockMem* allocator);
-	static void Destroy(P2DContact* contact, P2DBaseObject::Type typeA, P2DBaseObject::Type typeB, P2DBlockMem* allocator);
-	static void Destroy(P2DContact* contact, P2DBlockMem* allocator);
+	static P2DContact* Create(P2DFixture* fixtureA, int32 indexA, P2DFixture* fixtureB, int32 indexB, P2DPool* allocator);
+	static void Destroy(P2DContact* contact, P2DBaseObject::Type typeA, P2DBaseObject::Type typeB, P2DPool* allocator);
+	static void Destroy(P2DContact* contact, P2DPool* allocator);
 
 	P2DContact() : m_fixtureA(NULL), m_fixtureB(NULL) {}
 	P2DContact(P2DFixture* fixtureA, int32 indexA, P2DFixture* fixtureB, int32 indexB);
 	virtual ~P2DContact() {}
 
-	void Update(P2DContactListener* listener);
+	void Update(P2DContactListener* listener, P2DImpulseCache* cache);
 
 	static P2DContactRegister s_registers[P2DBaseObject::TypeCount][P2DBaseObject::TypeCount];
 	static bool s_initialized;
 
 	uint32 m_flags;
 
-	// World pool and list pointers.
-	P2DContact* m_prev;
-	P2DContact* m_next;
+	// Index in the world's contact array.
+	int32 m_arrayIndex;
 
 	// Nodes for connecting bodies.
 	P2DContactEdge m_nodeA;
@@ -195,6 +200,9 @@ protected:
 	int32 m_toiCount;
 	float32 m_toi;
 
+	// The simplex of the last TOI query, it warm starts the next one.
+	P2DSimplexCache m_toiCache;
+
 	float32 m_friction;
 	float32 m_restitution;
 
@@ -243,14 +251,9 @@ inline bool P2DContact::IsTouching() const
 	return (m_flags & e_touchingFlag) == e_touchingFlag;
 }
 
-inline P2DContact* P2DContact::GetNext()
-{
-	return m_next;
-}
-
-inline const P2DContact* P2DContact::GetNext() const
+inline P2DHandle P2DContact::GetHandle() const
 {
-	return m_next;
+	return P2DPool::GetHandle(this);
 }
 
 inline P2DFixture* P2DContact::GetFixtureA()
@@ -35,6 +35,9 @@ P2DContactSolver::P2DContactSolver(P2DContactSolverDef* def)
 	m_positions = def->positions;
 	m_velocities = def->velocities;
 	m_contacts = def->contacts;
+	m_softBiasRate = 0.0f;
+	m_softMassScale = 1.0f;
+	m_softImpulseScale = 0.0f;
 
 	// Initialize position independent portions of the constraints.
 	for (int32 i = 0; i < m_count; ++i)
@@ -583,6 +586,284 @@ void P2DContactSolver::SolveVelocityConstraints()
 	}
 }
 
+// Soft contact constraints. The contact is modeled as a damped spring with
+// stiffness given in hertz, solved implicitly so it is stable for any stiffness.
+// This replaces Baumgarte stabilization and the separate position iterations.
+// See Erin Catto, "Solver2D" (2024) and the "soft step" solver.
+void P2DContactSolver::InitializeSoftConstraints(float32 h)
+{
+	// Keep the spring well below the sub-step rate.
+	float32 contactHertz = P2DMin(P2D_SOFT_CONTACT_HERTZ, 0.25f * (h > 0.0f ? 1.0f / h : 0.0f));
+	float32 zeta = P2D_SOFT_CONTACT_DAMPING_RATIO;
+	float32 omega = 2.0f * PI * contactHertz;
+	float32 a1 = 2.0f * zeta + h * omega;
+	float32 a2 = h * omega * a1;
+	float32 a3 = 1.0f / (1.0f + a2);
+	m_softBiasRate = a1 > 0.0f ? omega / a1 : 0.0f;
+	m_softMassScale = a2 * a3;
+	m_softImpulseScale = a3;
+
+	// The manifolds keep whole step impulses, warm start with one sub-step's share.
+	float32 subStepRatio = h * m_step.inv_dt;
+
+	for (int32 i = 0; i < m_count; ++i)
+	{
+        P2DContactVelocityConstraint* vc = m_velocityConstraints + i;
+        P2DContactPositionConstraint* pc = m_positionConstraints + i;
+
+        P2DManifold* manifold = m_contacts[vc->contactIndex]->GetManifold();
+
+		int32 indexA = vc->indexA;
+		int32 indexB = vc->indexB;
+
+		float32 mA = vc->invMassA;
+		float32 mB = vc->invMassB;
+		float32 iA = vc->invIA;
+		float32 iB = vc->invIB;
+
+        P2DVec2 cA = m_positions[indexA].c;
+		float32 aA = m_positions[indexA].a;
+        P2DVec2 vA = m_velocities[indexA].v;
+		float32 wA = m_velocities[indexA].w;
+
+        P2DVec2 cB = m_positions[indexB].c;
+		float32 aB = m_positions[indexB].a;
+        P2DVec2 vB = m_velocities[indexB].v;
+		float32 wB = m_velocities[indexB].w;
+
+        P2DTransform xfA, xfB;
+        xfA.rotation.Set(aA);
+        xfB.rotation.Set(aB);
+        xfA.position = cA - P2DMul(xfA.rotation, pc->localCenterA);
+        xfB.position = cB - P2DMul(xfB.rotation, pc->localCenterB);
+
+        P2DSceneManifold worldManifold;
+		worldManifold.Initialize(manifold, xfA, pc->radiusA, xfB, pc->radiusB);
+
+		vc->normal = worldManifold.normal;
+		vc->angleA = aA;
+		vc->angleB = aB;
+
+        P2DVec2 tangent = P2DVecCross(vc->normal, 1.0f);
+
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+
+			vcp->rA = worldManifold.points[j] - cA;
+			vcp->rB = worldManifold.points[j] - cB;
+
+			// The separation is tracked from the body motion during the sub-steps.
+			vcp->adjustedSeparation = worldManifold.separations[j] - P2DVecDot((cB + vcp->rB) - (cA + vcp->rA), vc->normal);
+
+            float32 rnA = P2DVecCross(vcp->rA, vc->normal);
+            float32 rnB = P2DVecCross(vcp->rB, vc->normal);
+			float32 kNormal = mA + mB + iA * rnA * rnA + iB * rnB * rnB;
+			vcp->normalMass = kNormal > 0.0f ? 1.0f / kNormal : 0.0f;
+
+            float32 rtA = P2DVecCross(vcp->rA, tangent);
+            float32 rtB = P2DVecCross(vcp->rB, tangent);
+			float32 kTangent = mA + mB + iA * rtA * rtA + iB * rtB * rtB;
+			vcp->tangentMass = kTangent > 0.0f ? 1.0f / kTangent : 0.0f;
+
+			// Save the approach velocity for restitution.
+			vcp->relativeVelocity = P2DVecDot(vc->normal, vB + P2DVecCross(wB, vcp->rB) - vA - P2DVecCross(wA, vcp->rA));
+			vcp->maxNormalImpulse = 0.0f;
+			vcp->velocityBias = 0.0f;
+
+			vcp->normalImpulse *= subStepRatio;
+			vcp->tangentImpulse *= subStepRatio;
+			vcp->totalNormalImpulse = 0.0f;
+			vcp->totalTangentImpulse = 0.0f;
+		}
+	}
+}
+
+void P2DContactSolver::SolveSoftVelocityConstraints(float32 inv_h, bool useBias)
+{
+	for (int32 i = 0; i < m_count; ++i)
+	{
+        P2DContactVelocityConstraint* vc = m_velocityConstraints + i;
+
+		int32 indexA = vc->indexA;
+		int32 indexB = vc->indexB;
+		float32 mA = vc->invMassA;
+		float32 iA = vc->invIA;
+		float32 mB = vc->invMassB;
+		float32 iB = vc->invIB;
+		int32 pointCount = vc->pointCount;
+
+        P2DVec2 cA = m_positions[indexA].c;
+        P2DVec2 vA = m_velocities[indexA].v;
+		float32 wA = m_velocities[indexA].w;
+        P2DRot qA(m_positions[indexA].a - vc->angleA);
+
+        P2DVec2 cB = m_positions[indexB].c;
+        P2DVec2 vB = m_velocities[indexB].v;
+		float32 wB = m_velocities[indexB].w;
+        P2DRot qB(m_positions[indexB].a - vc->angleB);
+
+        P2DVec2 normal = vc->normal;
+        P2DVec2 tangent = P2DVecCross(normal, 1.0f);
+		float32 friction = vc->friction;
+
+		// Solve normal constraints first so friction sees the current support.
+		for (int32 j = 0; j < pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+
+			// Current separation from the anchors moved with the bodies.
+            P2DVec2 prA = P2DMul(qA, vcp->rA);
+            P2DVec2 prB = P2DMul(qB, vcp->rB);
+            float32 s = P2DVecDot((cB + prB) - (cA + prA), normal) + vcp->adjustedSeparation;
+
+			float32 velocityBias = 0.0f;
+			float32 massScale = 1.0f;
+			float32 impulseScale = 0.0f;
+			if (s > 0.0f)
+			{
+				// Speculative contact.
+				velocityBias = s * inv_h;
+			}
+			else if (useBias)
+			{
+				velocityBias = P2DMax(m_softBiasRate * s, -P2D_SOFT_CONTACT_PUSHOUT);
+				massScale = m_softMassScale;
+				impulseScale = m_softImpulseScale;
+			}
+
+            P2DVec2 dv = vB + P2DVecCross(wB, vcp->rB) - vA - P2DVecCross(wA, vcp->rA);
+            float32 vn = P2DVecDot(dv, normal);
+
+			float32 lambda = -vcp->normalMass * massScale * (vn + velocityBias) - impulseScale * vcp->normalImpulse;
+
+            float32 newImpulse = P2DMax(vcp->normalImpulse + lambda, 0.0f);
+			lambda = newImpulse - vcp->normalImpulse;
+			vcp->normalImpulse = newImpulse;
+			vcp->maxNormalImpulse = P2DMax(vcp->maxNormalImpulse, lambda);
+
+            P2DVec2 P = lambda * normal;
+			vA -= mA * P;
+            wA -= iA * P2DVecCross(vcp->rA, P);
+			vB += mB * P;
+            wB += iB * P2DVecCross(vcp->rB, P);
+		}
+
+		for (int32 j = 0; j < pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+
+            P2DVec2 dv = vB + P2DVecCross(wB, vcp->rB) - vA - P2DVecCross(wA, vcp->rA);
+            float32 vt = P2DVecDot(dv, tangent) - vc->tangentSpeed;
+			float32 lambda = vcp->tangentMass * (-vt);
+
+			float32 maxFriction = friction * vcp->normalImpulse;
+            float32 newImpulse = P2DClamp(vcp->tangentImpulse + lambda, -maxFriction, maxFriction);
+			lambda = newImpulse - vcp->tangentImpulse;
+			vcp->tangentImpulse = newImpulse;
+
+            P2DVec2 P = lambda * tangent;
+			vA -= mA * P;
+            wA -= iA * P2DVecCross(vcp->rA, P);
+			vB += mB * P;
+            wB += iB * P2DVecCross(vcp->rB, P);
+		}
+
+		m_velocities[indexA].v = vA;
+		m_velocities[indexA].w = wA;
+		m_velocities[indexB].v = vB;
+		m_velocities[indexB].w = wB;
+	}
+}
+
+void P2DContactSolver::ApplyRestitution()
+{
+	for (int32 i = 0; i < m_count; ++i)
+	{
+        P2DContactVelocityConstraint* vc = m_velocityConstraints + i;
+		if (vc->restitution == 0.0f)
+		{
+			continue;
+		}
+
+		int32 indexA = vc->indexA;
+		int32 indexB = vc->indexB;
+		float32 mA = vc->invMassA;
+		float32 iA = vc->invIA;
+		float32 mB = vc->invMassB;
+		float32 iB = vc->invIB;
+
+        P2DVec2 vA = m_velocities[indexA].v;
+		float32 wA = m_velocities[indexA].w;
+        P2DVec2 vB = m_velocities[indexB].v;
+		float32 wB = m_velocities[indexB].w;
+
+        P2DVec2 normal = vc->normal;
+
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+
+			// Only bounce points that were approaching fast enough and actually got pushed.
+			if (vcp->relativeVelocity > -P2D_VELOCITY_THRESHOLD || vcp->maxNormalImpulse == 0.0f)
+			{
+				continue;
+			}
+
+            P2DVec2 dv = vB + P2DVecCross(wB, vcp->rB) - vA - P2DVecCross(wA, vcp->rA);
+            float32 vn = P2DVecDot(dv, normal);
+
+			float32 lambda = -vcp->normalMass * (vn + vc->restitution * vcp->relativeVelocity);
+
+            float32 newImpulse = P2DMax(vcp->normalImpulse + lambda, 0.0f);
+			lambda = newImpulse - vcp->normalImpulse;
+			vcp->normalImpulse = newImpulse;
+			vcp->totalNormalImpulse += lambda;
+
+            P2DVec2 P = lambda * normal;
+			vA -= mA * P;
+            wA -= iA * P2DVecCross(vcp->rA, P);
+			vB += mB * P;
+            wB += iB * P2DVecCross(vcp->rB, P);
+		}
+
+		m_velocities[indexA].v = vA;
+		m_velocities[indexA].w = wA;
+		m_velocities[indexB].v = vB;
+		m_velocities[indexB].w = wB;
+	}
+}
+
+void P2DContactSolver::AccumulateSoftImpulses()
+{
+	// Warm starting re-applies the accumulated impulse every sub-step, so what
+	// a sub-step applied is the accumulated impulse at its end.
+	for (int32 i = 0; i < m_count; ++i)
+	{
+        P2DContactVelocityConstraint* vc = m_velocityConstraints + i;
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+			vcp->totalNormalImpulse += vcp->normalImpulse;
+			vcp->totalTangentImpulse += vcp->tangentImpulse;
+		}
+	}
+}
+
+void P2DContactSolver::FinishSoftImpulses()
+{
+	for (int32 i = 0; i < m_count; ++i)
+	{
+        P2DContactVelocityConstraint* vc = m_velocityConstraints + i;
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+            P2DVelocityConstraintPoint* vcp = vc->points + j;
+			vcp->normalImpulse = vcp->totalNormalImpulse;
+			vcp->tangentImpulse = vcp->totalTangentImpulse;
+		}
+	}
+}
+
 void P2DContactSolver::StoreImpulses()
 {
 	for (int32 i = 0; i < m_count; ++i)
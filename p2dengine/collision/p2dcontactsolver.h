@@ -19,6 +19,13 @@ struct P2DVelocityConstraintPoint
 	float32 normalMass;
 	float32 tangentMass;
 	float32 velocityBias;
+
+	// Soft step only.
+	float32 adjustedSeparation;
+	float32 relativeVelocity;
+	float32 maxNormalImpulse;
+	float32 totalNormalImpulse;
+	float32 totalTangentImpulse;
 };
 
 struct P2DContactVelocityConstraint
@@ -36,6 +43,9 @@ struct P2DContactVelocityConstraint
 	float32 tangentSpeed;
 	int32 pointCount;
 	int32 contactIndex;
+
+	// Soft step only. Body angles the anchors were computed with.
+	float32 angleA, angleB;
 };
 
 struct P2DContactSolverDef
@@ -63,6 +73,21 @@ public:
 	bool SolvePositionConstraints();
 	bool SolveTOIPositionConstraints(int32 toiIndexA, int32 toiIndexB);
 
+	/// Soft step pipeline, see P2DIsland::SolveSoft. The constraints are prepared
+	/// once per step for the sub-step length h. Each sub-step then warm starts,
+	/// solves with a soft bias, integrates positions and relaxes without bias.
+	void InitializeSoftConstraints(float32 h);
+	void SolveSoftVelocityConstraints(float32 inv_h, bool useBias);
+	void ApplyRestitution();
+
+	/// Add the impulses of the sub-step that just ended to the step totals.
+	void AccumulateSoftImpulses();
+
+	/// Replace the per sub-step impulses by the totals of the step, before
+	/// StoreImpulses and reporting. The manifolds then hold whole step impulses
+	/// in both pipelines, InitializeSoftConstraints scales them back down.
+	void FinishSoftImpulses();
+
 	P2DTimeStep m_step;
 	P2DPosition* m_positions;
 	P2DVelocity* m_velocities;
@@ -71,6 +96,11 @@ public:
 	P2DContactVelocityConstraint* m_velocityConstraints;
 	P2DContact** m_contacts;
 	int m_count;
+
+	// Soft contact coefficients for the current sub-step length.
+	float32 m_softBiasRate;
+	float32 m_softMassScale;
+	float32 m_softImpulseScale;
 };
 
 #endif
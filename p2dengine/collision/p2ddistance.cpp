@@ -590,3 +590,176 @@ void P2DDistance(P2DDistanceOutput* output,
 		}
 	}
 }
+
+// Running GJK on several pairs in lockstep, with the simplices in structure
+// of arrays form and branch free Voronoi region selection, was tried. With
+// 2-3 iterations per cold pair and about one per warm pair the simplex
+// bookkeeping costs more than the branches it removes, so pairs run one after
+// the other through the scalar code.
+void P2DDistanceBatch(P2DDistanceOutput* outputs,
+					  P2DSimplexCache* caches,
+					  const P2DDistanceInput* inputs, int32 count)
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		P2DDistance(outputs + i, caches + i, inputs + i);
+	}
+}
+
+// GJK ray cast of the Minkowski difference A - B along the translation.
+// Each support point gives a plane of the difference. The ray is advanced
+// to the plane whenever it lies in front of it, which never overshoots.
+bool P2DShapeCast(P2DShapeCastOutput* output, const P2DShapeCastInput* input)
+{
+	output->iterations = 0;
+	output->lambda = 1.0f;
+	output->normal.SetZero();
+	output->point.SetZero();
+
+	const P2DDistanceProxy* proxyA = &input->proxyA;
+	const P2DDistanceProxy* proxyB = &input->proxyB;
+
+	float32 radiusA = P2DMax(proxyA->m_radius, P2D_POLYGON_RADIUS);
+	float32 radiusB = P2DMax(proxyB->m_radius, P2D_POLYGON_RADIUS);
+	float32 radius = radiusA + radiusB;
+
+	P2DTransform transformA = input->transformA;
+	P2DTransform transformB = input->transformB;
+
+	P2DVec2 r = input->translationB;
+	P2DVec2 n(0.0f, 0.0f);
+	float32 lambda = 0.0f;
+
+	P2DSimplex simplex;
+	simplex.m_count = 0;
+	P2DSimplexVertex* vertices = &simplex.m_v1;
+
+	// Start with the support point in the -r direction.
+	int32 indexA = proxyA->GetSupport(P2DMulT(transformA.rotation, -r));
+	P2DVec2 wA = P2DMul(transformA, proxyA->GetVertex(indexA));
+	int32 indexB = proxyB->GetSupport(P2DMulT(transformB.rotation, r));
+	P2DVec2 wB = P2DMul(transformB, proxyB->GetVertex(indexB));
+	P2DVec2 v = wA - wB;
+
+	// The target distance between the cores of the shapes.
+	float32 sigma = P2DMax(P2D_POLYGON_RADIUS, radius - P2D_POLYGON_RADIUS);
+	const float32 tolerance = 0.5f * P2D_LINEAR_SLOP;
+
+	const int32 k_maxIters = 20;
+	int32 iter = 0;
+	bool overlap = false;
+	while (iter < k_maxIters && v.Length() - sigma > tolerance)
+	{
+		assert(simplex.m_count < 3);
+
+		// Support in the direction -v (A - B).
+		indexA = proxyA->GetSupport(P2DMulT(transformA.rotation, -v));
+		wA = P2DMul(transformA, proxyA->GetVertex(indexA));
+		indexB = proxyB->GetSupport(P2DMulT(transformB.rotation, v));
+		wB = P2DMul(transformB, proxyB->GetVertex(indexB));
+		P2DVec2 p = wA - wB;
+
+		// -v is a normal at p.
+		v.Normalize();
+
+		// Intersect the ray with the plane.
+		float32 vp = P2DVecDot(v, p);
+		float32 vr = P2DVecDot(v, r);
+		if (vp - sigma > lambda * vr)
+		{
+			if (vr <= 0.0f)
+			{
+				// Moving away from the plane, a miss.
+				return false;
+			}
+
+			lambda = (vp - sigma) / vr;
+			if (lambda > 1.0f)
+			{
+				// The plane is beyond the translation, a miss.
+				return false;
+			}
+
+			n = -v;
+			simplex.m_count = 0;
+		}
+
+		// The simplex works with B - A, so the roles are swapped. Shape B is
+		// shifted to the current clip point, the support point is not so the
+		// plane stays in unshifted space.
+		P2DSimplexVertex* vertex = vertices + simplex.m_count;
+		vertex->indexA = indexB;
+		vertex->wA = wB + lambda * r;
+		vertex->indexB = indexA;
+		vertex->wB = wA;
+		vertex->w = vertex->wB - vertex->wA;
+		vertex->a = 1.0f;
+		++simplex.m_count;
+
+		switch (simplex.m_count)
+		{
+		case 1:
+			break;
+
+		case 2:
+			simplex.Solve2();
+			break;
+
+		case 3:
+			simplex.Solve3();
+			break;
+
+		default:
+			assert(false);
+		}
+
+		++iter;
+		++p2d_gjkIters;
+
+		// If we have 3 points, then the origin is in the corresponding triangle.
+		if (simplex.m_count == 3)
+		{
+			overlap = true;
+			break;
+		}
+
+		v = simplex.GetClosestPoint();
+	}
+
+	output->iterations = iter;
+
+	if (iter == 0 || (overlap && lambda == 0.0f))
+	{
+		// The shapes touch at the start. Report the middle of the closest
+		// features, there is no meaningful normal.
+		P2DDistanceInput distanceInput;
+		distanceInput.proxyA = *proxyA;
+		distanceInput.proxyB = *proxyB;
+		distanceInput.transformA = transformA;
+		distanceInput.transformB = transformB;
+		distanceInput.useRadii = true;
+
+		P2DSimplexCache cache;
+		cache.count = 0;
+		P2DDistanceOutput distanceOutput;
+		P2DDistance(&distanceOutput, &cache, &distanceInput);
+
+		output->point = distanceOutput.pointA;
+		output->lambda = 0.0f;
+		return true;
+	}
+
+	P2DVec2 pointA, pointB;
+	simplex.GetWitnessPoints(&pointB, &pointA);
+
+	if (v.LengthSquared() > 0.0f)
+	{
+		n = -v;
+		n.Normalize();
+	}
+
+	output->point = pointA + radiusA * n;
+	output->normal = n;
+	output->lambda = lambda;
+	return true;
+}
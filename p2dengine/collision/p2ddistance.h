@@ -71,6 +71,43 @@ void P2DDistance(P2DDistanceOutput* output,
 				P2DSimplexCache* cache, 
 				const P2DDistanceInput* input);
 
+/// Compute the closest points of many shape pairs, e.g. all the sensor pairs
+/// of a step. The results are the same as calling P2DDistance for each pair.
+/// Keep the caches from the previous frame to warm start the pairs, a warm
+/// pair usually converges in a single iteration.
+/// @param outputs receives count outputs.
+/// @param caches count simplex caches, input/output.
+/// @param inputs count inputs.
+void P2DDistanceBatch(P2DDistanceOutput* outputs,
+					  P2DSimplexCache* caches,
+					  const P2DDistanceInput* inputs, int32 count);
+
+/// Input for P2DShapeCast. Shape B moves by translationB, shape A is fixed.
+struct P2DShapeCastInput
+{
+	P2DDistanceProxy proxyA;
+	P2DDistanceProxy proxyB;
+	P2DTransform transformA;
+	P2DTransform transformB;
+	P2DVec2 translationB;
+};
+
+/// Output for P2DShapeCast.
+struct P2DShapeCastOutput
+{
+	P2DVec2 point;		///< the point of first contact, on the surface of shape A
+	P2DVec2 normal;		///< the normal of shape A at the point, zero if the shapes start overlapped
+	float32 lambda;		///< the fraction of translationB travelled before the contact
+	int32 iterations;	///< number of GJK iterations used
+};
+
+/// Sweep shape B along a translation and find where it first touches shape A.
+/// This is conservative advancement on the GJK simplex (Gino van den Bergen's
+/// GJK ray cast), so it needs no sweep and no root finder.
+/// Shapes that already touch at the start report a hit with lambda = 0.
+/// @return true if the shapes touch within the translation.
+bool P2DShapeCast(P2DShapeCastOutput* output, const P2DShapeCastInput* input);
+
 
 //////////////////////////////////////////////////////////////////////////
 
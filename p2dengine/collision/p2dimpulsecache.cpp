@@ -0,0 +1,205 @@
+#include "p2dimpulsecache.h"
+#include "p2dcontact.h"
+#include "../general/p2dmem.h"
+
+const int32 IMPULSE_CACHE_INITIAL_CAPACITY = 64;
+
+static inline uint32 P2DImpulseHash(const P2DFixture* fixtureA, int32 indexA,
+									const P2DFixture* fixtureB, int32 indexB, uint32 key)
+{
+	uint32 h = (uint32)(size_t)fixtureA * 73856093u;
+	h ^= (uint32)(size_t)fixtureB * 19349663u;
+	h ^= ((uint32)indexA << 16 | (uint32)indexB) * 83492791u;
+	h ^= key * 2654435761u;
+
+	// Final avalanche so the low bits used for the slot index are well mixed.
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+P2DImpulseCache::P2DImpulseCache()
+{
+	m_entries = NULL;
+	m_capacity = 0;
+	m_count = 0;
+	m_stamp = 0;
+}
+
+P2DImpulseCache::~P2DImpulseCache()
+{
+	MemFree(m_entries);
+}
+
+int32 P2DImpulseCache::FindSlot(const P2DFixture* fixtureA, int32 indexA,
+								const P2DFixture* fixtureB, int32 indexB, uint32 key) const
+{
+	assert(m_capacity > 0);
+
+	// Linear probing. The load factor is kept below one half so there is always an empty slot.
+	int32 mask = m_capacity - 1;
+	int32 slot = (int32)(P2DImpulseHash(fixtureA, indexA, fixtureB, indexB, key) & (uint32)mask);
+	for (;;)
+	{
+		const P2DImpulseCacheEntry* e = m_entries + slot;
+		if (e->fixtureA == NULL)
+		{
+			return slot;
+		}
+
+		if (e->fixtureA == fixtureA && e->fixtureB == fixtureB &&
+			e->indexA == indexA && e->indexB == indexB && e->key == key)
+		{
+			return slot;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+}
+
+void P2DImpulseCache::Rebuild(int32 capacity, int32 minStamp, const P2DFixture* purged)
+{
+	P2DImpulseCacheEntry* oldEntries = m_entries;
+	int32 oldCapacity = m_capacity;
+
+	m_capacity = capacity;
+	m_entries = (P2DImpulseCacheEntry*)MemAlloc(m_capacity * sizeof(P2DImpulseCacheEntry));
+	memset(m_entries, 0, m_capacity * sizeof(P2DImpulseCacheEntry));
+	m_count = 0;
+
+	for (int32 i = 0; i < oldCapacity; ++i)
+	{
+		const P2DImpulseCacheEntry* e = oldEntries + i;
+		if (e->fixtureA == NULL || e->stamp < minStamp)
+		{
+			continue;
+		}
+
+		if (purged != NULL && (e->fixtureA == purged || e->fixtureB == purged))
+		{
+			continue;
+		}
+
+		int32 slot = FindSlot(e->fixtureA, e->indexA, e->fixtureB, e->indexB, e->key);
+		m_entries[slot] = *e;
+		++m_count;
+	}
+
+	MemFree(oldEntries);
+}
+
+void P2DImpulseCache::Store(const P2DContact* contact)
+{
+	const P2DManifold* manifold = contact->GetManifold();
+	for (int32 i = 0; i < manifold->pointCount; ++i)
+	{
+		Store(contact->GetFixtureA(), contact->GetChildIndexA(),
+			  contact->GetFixtureB(), contact->GetChildIndexB(), manifold->points[i]);
+	}
+}
+
+void P2DImpulseCache::Store(const P2DFixture* fixtureA, int32 indexA,
+							const P2DFixture* fixtureB, int32 indexB, const P2DManifoldPoint& mp)
+{
+	// Nothing to warm start with.
+	if (mp.normalImpulse == 0.0f && mp.tangentImpulse == 0.0f)
+	{
+		return;
+	}
+
+	if (2 * (m_count + 1) > m_capacity)
+	{
+		Rebuild(P2DMax(2 * m_capacity, IMPULSE_CACHE_INITIAL_CAPACITY), m_stamp - P2D_IMPULSE_CACHE_STEPS, NULL);
+	}
+
+	int32 slot = FindSlot(fixtureA, indexA, fixtureB, indexB, mp.id.key);
+	P2DImpulseCacheEntry* e = m_entries + slot;
+	if (e->fixtureA == NULL)
+	{
+		e->fixtureA = fixtureA;
+		e->fixtureB = fixtureB;
+		e->indexA = indexA;
+		e->indexB = indexB;
+		e->key = mp.id.key;
+		++m_count;
+	}
+
+	e->normalImpulse = mp.normalImpulse;
+	e->tangentImpulse = mp.tangentImpulse;
+	e->stamp = m_stamp;
+}
+
+bool P2DImpulseCache::Fetch(const P2DFixture* fixtureA, int32 indexA,
+							const P2DFixture* fixtureB, int32 indexB, P2DManifoldPoint* mp) const
+{
+	if (m_count == 0)
+	{
+		return false;
+	}
+
+	const P2DImpulseCacheEntry* e = m_entries + FindSlot(fixtureA, indexA, fixtureB, indexB, mp->id.key);
+	if (e->fixtureA == NULL)
+	{
+		return false;
+	}
+
+	// Expired entries stay in the table until the next eviction pass.
+	if (e->stamp < m_stamp - P2D_IMPULSE_CACHE_STEPS)
+	{
+		return false;
+	}
+
+	mp->normalImpulse = e->normalImpulse;
+	mp->tangentImpulse = e->tangentImpulse;
+	return true;
+}
+
+void P2DImpulseCache::Step()
+{
+	++m_stamp;
+
+	if (m_count == 0)
+	{
+		return;
+	}
+
+	// Only pay for a rebuild when something actually expired.
+	int32 minStamp = m_stamp - P2D_IMPULSE_CACHE_STEPS;
+	for (int32 i = 0; i < m_capacity; ++i)
+	{
+		const P2DImpulseCacheEntry* e = m_entries + i;
+		if (e->fixtureA != NULL && e->stamp < minStamp)
+		{
+			Rebuild(m_capacity, minStamp, NULL);
+			return;
+		}
+	}
+}
+
+void P2DImpulseCache::Purge(const P2DFixture* fixture)
+{
+	if (m_count == 0)
+	{
+		return;
+	}
+
+	for (int32 i = 0; i < m_capacity; ++i)
+	{
+		const P2DImpulseCacheEntry* e = m_entries + i;
+		if (e->fixtureA == fixture || (e->fixtureA != NULL && e->fixtureB == fixture))
+		{
+			Rebuild(m_capacity, m_stamp - P2D_IMPULSE_CACHE_STEPS, fixture);
+			return;
+		}
+	}
+}
+
+void P2DImpulseCache::Clear()
+{
+	if (m_capacity > 0)
+	{
+		memset(m_entries, 0, m_capacity * sizeof(P2DImpulseCacheEntry));
+	}
+	m_count = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef P2D_IMPULSE_CACHE_H
+#define P2D_IMPULSE_CACHE_H
+
+#include "../general/p2dparams.h"
+#include "p2dcollision.h"
+
+class P2DContact;
+class P2DFixture;
+
+/// A cached manifold point impulse. An entry is identified by the fixture pair,
+/// the child indices and the contact feature key of the point.
+struct P2DImpulseCacheEntry
+{
+	const P2DFixture* fixtureA;
+	const P2DFixture* fixtureB;
+	int32 indexA;
+	int32 indexB;
+	uint32 key;
+	float32 normalImpulse;
+	float32 tangentImpulse;
+	int32 stamp;
+};
+
+/// This keeps the accumulated impulses of contact points that went away for a few
+/// steps, so a contact that comes back (an object bouncing on a resting stack, or a
+/// pair that flickers at the fat AABB boundary) can be warm started again instead
+/// of starting the solver from zero.
+/// Entries older than P2D_IMPULSE_CACHE_STEPS are evicted by Step().
+class P2DImpulseCache
+{
+public:
+	P2DImpulseCache();
+	~P2DImpulseCache();
+
+	/// Remember the impulses of all the points of a contact manifold.
+	void Store(const P2DContact* contact);
+
+	/// Remember the impulses of a single manifold point.
+	void Store(const P2DFixture* fixtureA, int32 indexA,
+			   const P2DFixture* fixtureB, int32 indexB, const P2DManifoldPoint& mp);
+
+	/// Look up the impulses of a manifold point. The impulses are copied into mp
+	/// on a hit.
+	/// @return true if the point was found and has not expired.
+	bool Fetch(const P2DFixture* fixtureA, int32 indexA,
+			   const P2DFixture* fixtureB, int32 indexB, P2DManifoldPoint* mp) const;
+
+	/// Advance the cache by one time step and evict the stale entries.
+	void Step();
+
+	/// Remove all the entries that reference a fixture. Call this before the
+	/// fixture memory is released.
+	void Purge(const P2DFixture* fixture);
+
+	/// Remove all the entries.
+	void Clear();
+
+	/// Get the number of cached points.
+	int32 GetCount() const;
+
+private:
+
+	int32 FindSlot(const P2DFixture* fixtureA, int32 indexA,
+				   const P2DFixture* fixtureB, int32 indexB, uint32 key) const;
+	void Rebuild(int32 capacity, int32 minStamp, const P2DFixture* purged);
+
+	P2DImpulseCacheEntry* m_entries;
+	int32 m_capacity;
+	int32 m_count;
+	int32 m_stamp;
+};
+
+inline int32 P2DImpulseCache::GetCount() const
+{
+	return m_count;
+}
+
+#endif
@@ -1,5 +1,5 @@
 #include "p2dpolygoncontact.h"
-#include "../general/p2dmem.h"
+#include "../general/p2dpool.h"
 #include "../collision/p2dtoi.h"
 #include "../scene/p2dbody.h"
 #include "../scene/p2dfixture.h"
@@ -7,16 +7,16 @@
 
 #include <new>
 
-P2DContact* P2DPolygonContact::Create(P2DFixture* fixtureA, int32, P2DFixture* fixtureB, int32, P2DBlockMem* allocator)
+P2DContact* P2DPolygonContact::Create(P2DFixture* fixtureA, int32, P2DFixture* fixtureB, int32, P2DPool* allocator)
 {
     void* mem = allocator->Allocate(sizeof(P2DPolygonContact));
     return new (mem) P2DPolygonContact(fixtureA, fixtureB);
 }
 
-void P2DPolygonContact::Destroy(P2DContact* contact, P2DBlockMem* allocator)
+void P2DPolygonContact::Destroy(P2DContact* contact, P2DPool* allocator)
 {
     ((P2DPolygonContact*)contact)->~P2DPolygonContact();
-    allocator->Free(contact, sizeof(P2DPolygonContact));
+    allocator->Free(contact);
 }
 
 P2DPolygonContact::P2DPolygonContact(P2DFixture* fixtureA, P2DFixture* fixtureB)
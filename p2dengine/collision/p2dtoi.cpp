@@ -240,6 +240,7 @@ void P2DTimeOfImpact(P2DTOIOutput* output, const P2DTOIInput* input)
 
 	output->state = P2DTOIOutput::e_unknown;
 	output->t = input->tMax;
+	output->rootIterations = 0;
 
 	const P2DDistanceProxy* proxyA = &input->proxyA;
 	const P2DDistanceProxy* proxyB = &input->proxyB;
@@ -263,9 +264,14 @@ void P2DTimeOfImpact(P2DTOIOutput* output, const P2DTOIInput* input)
     const int32 k_maxIterations = 20;	// TODO P2DParams
 	int32 iter = 0;
 
-	// Prepare input for distance query.
+	// Prepare input for distance query. P2DDistance checks a cached simplex
+	// and flushes it if it no longer fits the shapes.
 	P2DSimplexCache cache;
 	cache.count = 0;
+	if (input->cache != NULL)
+	{
+		cache = *input->cache;
+	}
 	P2DDistanceInput distanceInput;
 	distanceInput.proxyA = input->proxyA;
 	distanceInput.proxyB = input->proxyB;
@@ -433,6 +439,7 @@ void P2DTimeOfImpact(P2DTOIOutput* output, const P2DTOIInput* input)
 			}
 
 			p2d_toiMaxRootIters = P2DMax(p2d_toiMaxRootIters, rootIterCount);
+			output->rootIterations += rootIterCount;
 
 			++pushBackIter;
 
@@ -460,6 +467,12 @@ void P2DTimeOfImpact(P2DTOIOutput* output, const P2DTOIInput* input)
 	}
 
 	p2d_toiMaxIters = P2DMax(p2d_toiMaxIters, iter);
+	output->iterations = iter;
+
+	if (input->cache != NULL)
+	{
+		*input->cache = cache;
+	}
 
 	float32 time = timer.GetMilliseconds();
 	p2d_toiMaxTime = P2DMax(p2d_toiMaxTime, time);
@@ -7,11 +7,18 @@
 /// Input parameters for P2DTimeOfImpact
 struct P2DTOIInput
 {
+	P2DTOIInput() : cache(NULL) {}
+
 	P2DDistanceProxy proxyA;
 	P2DDistanceProxy proxyB;
 	P2DSweep sweepA;
 	P2DSweep sweepB;
 	float32 tMax;		// defines sweep interval [0, tMax]
+
+	/// The simplex of the last query on the same pair of shapes, input/output.
+	/// The first separating axis is built from it, so a pair queried again
+	/// starts from the axis that separated it last time. NULL starts cold.
+	P2DSimplexCache* cache;
 };
 
 // Output parameters for P2DTimeOfImpact.
@@ -28,6 +35,8 @@ struct P2DTOIOutput
 
 	State state;
 	float32 t;
+	int32 iterations;		///< the number of separating axes tried
+	int32 rootIterations;	///< the number of root finder iterations over all axes
 };
 
 /// Compute the upper bound on time before two shapes penetrate. Time is represented as
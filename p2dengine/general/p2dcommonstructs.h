@@ -14,6 +14,27 @@ struct P2DProfile
 	float32 solvePosition;
     float32 coarseCollision;
 	float32 solveTOI;
+	int32 syncCount;		///< bodies whose fixtures were synchronized after the island solve
+	int32 syncSkipCount;	///< bodies skipped because they did not move since their last sync
+	int32 reinsertCount;	///< proxies that left their fat AABB and were re-inserted into the tree
+	int32 toiCount;			///< TOI queries run by the continuous collision pass
+	int32 toiIterations;	///< separating axes tried by those queries
+	int32 toiRootIterations;	///< root finder iterations of those queries
+	int32 toiRootHistogram[P2D_TOI_ROOT_HISTOGRAM_BINS];	///< TOI queries by root finder iterations, see P2D_TOI_ROOT_HISTOGRAM_BINS
+};
+
+/// Reports what a budgeted P2DScene::Step gave up to stay within its
+/// time budget. Times are in milliseconds.
+struct P2DStepBudgetReport
+{
+	float32 budget;				///< the requested budget
+	float32 elapsed;			///< the time the step actually took
+	int32 degradeLevel;			///< 0 when nothing was degraded, up to 3
+	int32 velocityIterations;	///< velocity iterations actually used
+	int32 positionIterations;	///< position iterations actually used
+	int32 softSubSteps;			///< soft step sub-steps actually used
+	bool deferredTOI;			///< only bullets got continuous collision
+	bool skippedSleep;			///< sleep checks were skipped
 };
 
 /// This is an internal structure.
@@ -24,7 +45,10 @@ struct P2DTimeStep
 	float32 dtRatio;	// dt * inv_dt0
 	int32 velocityIterations;
 	int32 positionIterations;
+	int32 softSubSteps;	// sub-steps for the soft step solver
 	bool warmStarting;
+	bool deferTOI;		// only bullets get TOI events
+	bool skipSleep;		// don't update sleep timers
 };
 
 /// This is an internal structure.
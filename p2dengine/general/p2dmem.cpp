@@ -2,49 +2,223 @@
 #include "p2dmath.h"
 
 // Memory allocators for common use.
-void* MemAlloc(int32 size)
+// Every allocation is preceded by a small header holding its size and
+// category, so MemFree can keep the counters without being told the size.
+// The header is 16 bytes to keep the alignment malloc gives us.
+const int32 MEM_HEADER_SIZE = 16;
+
+static void* DefaultAlloc(int32 size, void* userData)
 {
+	NOT_USED(userData);
 	return malloc(size);
 }
 
-void MemFree(void* mem)
+static void DefaultFree(void* mem, void* userData)
 {
+	NOT_USED(userData);
 	free(mem);
 }
 
+static P2DMemAllocFcn s_allocFcn = DefaultAlloc;
+static P2DMemFreeFcn s_freeFcn = DefaultFree;
+static void* s_memUserData = NULL;
+
+// Index e_memCategoryCount holds the totals.
+static volatile int32 s_liveBytes[e_memCategoryCount + 1];
+static volatile int32 s_peakBytes[e_memCategoryCount + 1];
+static volatile int32 s_allocationCounts[e_memCategoryCount + 1];
+
+void SetMemHooks(P2DMemAllocFcn allocFcn, P2DMemFreeFcn freeFcn, void* userData)
+{
+	// Memory must be returned to the allocator it came from.
+	assert(s_liveBytes[e_memCategoryCount] == 0);
+	assert((allocFcn == NULL) == (freeFcn == NULL));
+
+	if (allocFcn == NULL || freeFcn == NULL)
+	{
+		s_allocFcn = DefaultAlloc;
+		s_freeFcn = DefaultFree;
+		s_memUserData = NULL;
+		return;
+	}
+
+	s_allocFcn = allocFcn;
+	s_freeFcn = freeFcn;
+	s_memUserData = userData;
+}
+
+P2DMemStats GetMemStats(P2DMemCategory category)
+{
+	assert(0 <= category && category < e_memCategoryCount);
+
+	P2DMemStats stats;
+	stats.liveBytes = s_liveBytes[category];
+	stats.peakBytes = s_peakBytes[category];
+	stats.allocationCount = s_allocationCounts[category];
+	return stats;
+}
+
+P2DMemStats GetMemTotalStats()
+{
+	P2DMemStats stats;
+	stats.liveBytes = s_liveBytes[e_memCategoryCount];
+	stats.peakBytes = s_peakBytes[e_memCategoryCount];
+	stats.allocationCount = s_allocationCounts[e_memCategoryCount];
+	return stats;
+}
+
+static void TrackMem(int32 category, int32 delta)
+{
+	int32 live = P2DAtomicAdd(s_liveBytes + category, delta);
+	int32 total = P2DAtomicAdd(s_liveBytes + e_memCategoryCount, delta);
+	if (delta > 0)
+	{
+		P2DAtomicAdd(s_allocationCounts + category, 1);
+		P2DAtomicAdd(s_allocationCounts + e_memCategoryCount, 1);
+		P2DAtomicMax(s_peakBytes + category, live);
+		P2DAtomicMax(s_peakBytes + e_memCategoryCount, total);
+	}
+}
+
+void* MemAlloc(int32 size, P2DMemCategory category)
+{
+	assert(0 <= category && category < e_memCategoryCount);
+
+	int8* mem = (int8*)s_allocFcn(size + MEM_HEADER_SIZE, s_memUserData);
+	if (mem == NULL)
+	{
+		return NULL;
+	}
+
+	int32* header = (int32*)mem;
+	header[0] = size;
+	header[1] = category;
+	TrackMem(category, size);
+
+	return mem + MEM_HEADER_SIZE;
+}
+
+void MemFree(void* mem)
+{
+	if (mem == NULL)
+	{
+		return;
+	}
+
+	int8* base = (int8*)mem - MEM_HEADER_SIZE;
+	int32* header = (int32*)base;
+	TrackMem(header[1], -header[0]);
+
+	s_freeFcn(base, s_memUserData);
+}
+
 // =======STACK=MEM=======
 P2DStackMem::P2DStackMem()
 {
-	m_index = 0;
+	m_pageCount = 0;
+	m_currentPage = 0;
+	m_reserved = 0;
 	m_allocation = 0;
 	m_maxAllocation = 0;
+	m_fallbackCount = 0;
+	m_entries = m_entryArray;
 	m_entryCount = 0;
+	m_entryCapacity = MAX_STACK_ENTRIES;
+	m_maxEntryCount = 0;
 }
 
 P2DStackMem::~P2DStackMem()
 {
-	assert(m_index == 0);
+	assert(m_allocation == 0);
 	assert(m_entryCount == 0);
+
+	for (int32 i = 0; i < m_pageCount; ++i)
+	{
+		MemFree(m_pages[i].data);
+	}
+
+	if (m_entries != m_entryArray)
+	{
+		MemFree(m_entries);
+	}
+}
+
+void P2DStackMem::AddPage(int32 size)
+{
+	assert(m_pageCount < MAX_STACK_PAGES);
+
+	P2DStackPage* page = m_pages + m_pageCount;
+	page->data = (char*)MemAlloc(size, e_memStack);
+	page->size = size;
+	page->index = 0;
+	m_reserved += size;
+	++m_pageCount;
+}
+
+void P2DStackMem::GrowEntries()
+{
+	P2DStackEntry* old = m_entries;
+	m_entryCapacity *= 2;
+	m_entries = (P2DStackEntry*)MemAlloc(m_entryCapacity * sizeof(P2DStackEntry), e_memStack);
+	memcpy(m_entries, old, m_entryCount * sizeof(P2DStackEntry));
+	if (old != m_entryArray)
+	{
+		MemFree(old);
+	}
 }
 
 void* P2DStackMem::Allocate(int32 size)
 {
-	assert(m_entryCount < MAX_STACK_ENTRIES);
+	assert(0 <= size);
+
+	if (m_entryCount == m_entryCapacity)
+	{
+		GrowEntries();
+	}
+
+	// Keep every allocation pointer aligned.
+	int32 used = (size + 7) & ~7;
+
+	if (m_pageCount == 0)
+	{
+		AddPage(P2DMax(STACK_SIZE, used));
+	}
+
+	P2DStackPage* page = m_pages + m_currentPage;
+	if (page->index + used > page->size)
+	{
+		// The pages after the current one are empty. Use the next one if it
+		// is big enough, otherwise replace them with a bigger page.
+		int32 next = m_currentPage + 1;
+		if (next == m_pageCount || m_pages[next].size < used)
+		{
+			for (int32 i = next; i < m_pageCount; ++i)
+			{
+				assert(m_pages[i].index == 0);
+				m_reserved -= m_pages[i].size;
+				MemFree(m_pages[i].data);
+			}
+			m_pageCount = next;
+
+			AddPage(P2DMax(2 * page->size, used));
+			++m_fallbackCount;
+		}
+
+		m_currentPage = next;
+		page = m_pages + m_currentPage;
+	}
 
 	P2DStackEntry* entry = m_entries + m_entryCount;
+	entry->data = page->data + page->index;
 	entry->size = size;
-	if (m_index + size > STACK_SIZE) {
-		entry->data = (char*)MemAlloc(size);
-		entry->usedMalloc = true;
-	} else {
-		entry->data = m_data + m_index;
-		entry->usedMalloc = false;
-		m_index += size;
-	}
+	entry->used = used;
+	entry->page = m_currentPage;
+	page->index += used;
 
 	m_allocation += size;
 	m_maxAllocation = P2DMax(m_maxAllocation, m_allocation);
 	++m_entryCount;
+	m_maxEntryCount = P2DMax(m_maxEntryCount, m_entryCount);
 
 	return entry->data;
 }
@@ -54,15 +228,27 @@ void P2DStackMem::Free(void* p)
 	assert(m_entryCount > 0);
 	P2DStackEntry* entry = m_entries + m_entryCount - 1;
 	assert(p == entry->data);
-	if (entry->usedMalloc){
-		MemFree(p);
-	} else {
-		m_index -= entry->size;
-	}
+	NOT_USED(p);
+
+	m_pages[entry->page].index -= entry->used;
 	m_allocation -= entry->size;
 	--m_entryCount;
 
-	p = NULL;
+	m_currentPage = m_entryCount > 0 ? m_entries[m_entryCount - 1].page : 0;
+
+	// Merge the pages once the stack is empty so the next step fits in one page.
+	if (m_entryCount == 0 && m_pageCount > 1)
+	{
+		int32 size = m_reserved;
+		for (int32 i = 0; i < m_pageCount; ++i)
+		{
+			MemFree(m_pages[i].data);
+		}
+		m_pageCount = 0;
+		m_reserved = 0;
+
+		AddPage(size);
+	}
 }
 
 int32 P2DStackMem::GetMaxAllocation() const
@@ -70,6 +256,16 @@ int32 P2DStackMem::GetMaxAllocation() const
 	return m_maxAllocation;
 }
 
+P2DStackStats P2DStackMem::GetStats() const
+{
+	P2DStackStats stats;
+	stats.maxAllocation = m_maxAllocation;
+	stats.reserved = m_reserved;
+	stats.fallbackCount = m_fallbackCount;
+	stats.maxEntryCount = m_maxEntryCount;
+	return stats;
+}
+
 
 // =======BLOCK=MEM=======
 #include <limits.h>
@@ -95,6 +291,23 @@ int32 P2DBlockMem::s_blockSizes[BLOCK_SIZES] =
 };
 uint8 P2DBlockMem::s_blockSizeLookup[MAX_BLOCK_SIZE + 1];
 bool P2DBlockMem::s_blockSizeLookupInitialized;
+P2DBlockMem* P2DBlockMem::s_allocators = NULL;
+
+// Guards the list of allocators. This is a plain integer rather than a
+// P2DMutex, allocators may be constructed before any other static object.
+static volatile int32 s_allocatorsLock = 0;
+
+static void LockAllocators()
+{
+	while (P2DAtomicCompareExchange(&s_allocatorsLock, 0, 1) != 0)
+	{
+	}
+}
+
+static void UnlockAllocators()
+{
+	P2DAtomicCompareExchange(&s_allocatorsLock, 1, 0);
+}
 
 
 P2DBlockMem::P2DBlockMem()
@@ -103,10 +316,15 @@ P2DBlockMem::P2DBlockMem()
 
 	m_chunkSpace = CHUNK_ARRAY_INCREMENT;
 	m_chunkCount = 0;
-	m_chunks = (P2DChunk*)MemAlloc(m_chunkSpace * sizeof(P2DChunk));
+	m_chunks = (P2DChunk*)MemAlloc(m_chunkSpace * sizeof(P2DChunk), e_memBlocks);
 	
 	memset(m_chunks, 0, m_chunkSpace * sizeof(P2DChunk));
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+	memset(m_freeCounts, 0, sizeof(m_freeCounts));
+	memset(m_chunkCounts, 0, sizeof(m_chunkCounts));
+	memset(m_peakBlocks, 0, sizeof(m_peakBlocks));
+	memset(m_sharedAllocations, 0, sizeof(m_sharedAllocations));
+	memset(m_caches, 0, sizeof(m_caches));
 
 	if (s_blockSizeLookupInitialized == false)
 	{
@@ -127,10 +345,35 @@ P2DBlockMem::P2DBlockMem()
 
 		s_blockSizeLookupInitialized = true;
 	}
+
+	LockAllocators();
+	m_prev = NULL;
+	m_next = s_allocators;
+	if (s_allocators != NULL)
+	{
+		s_allocators->m_prev = this;
+	}
+	s_allocators = this;
+	UnlockAllocators();
 }
 
 P2DBlockMem::~P2DBlockMem()
 {
+	LockAllocators();
+	if (m_prev != NULL)
+	{
+		m_prev->m_next = m_next;
+	}
+	else
+	{
+		s_allocators = m_next;
+	}
+	if (m_next != NULL)
+	{
+		m_next->m_prev = m_prev;
+	}
+	UnlockAllocators();
+
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
 		MemFree(m_chunks[i].blocks);
@@ -139,7 +382,117 @@ P2DBlockMem::~P2DBlockMem()
 	MemFree(m_chunks);
 }
 
-void* P2DBlockMem::Allocate(int32 size)
+// Carve a new chunk into blocks and put them on the shared free list.
+// The mutex must be held.
+void P2DBlockMem::AddChunk(int32 index)
+{
+	if (m_chunkCount == m_chunkSpace)
+	{
+		P2DChunk* oldChunks = m_chunks;
+		m_chunkSpace += CHUNK_ARRAY_INCREMENT;
+		m_chunks = (P2DChunk*)MemAlloc(m_chunkSpace * sizeof(P2DChunk), e_memBlocks);
+		memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(P2DChunk));
+		memset(m_chunks + m_chunkCount, 0, CHUNK_ARRAY_INCREMENT * sizeof(P2DChunk));
+		MemFree(oldChunks);
+	}
+
+	P2DChunk* chunk = m_chunks + m_chunkCount;
+	chunk->blocks = (P2DBlock*)MemAlloc(CHUNK_SIZE, e_memBlocks);
+#if defined(_DEBUG)
+	memset(chunk->blocks, 0xcd, CHUNK_SIZE);
+#endif
+	int32 blockSize = s_blockSizes[index];
+	chunk->blockSize = blockSize;
+	int32 blockCount = CHUNK_SIZE / blockSize;
+	assert(blockCount * blockSize <= CHUNK_SIZE);
+	for (int32 i = 0; i < blockCount - 1; ++i)
+	{
+		P2DBlock* block = (P2DBlock*)((int8*)chunk->blocks + blockSize * i);
+		P2DBlock* next = (P2DBlock*)((int8*)chunk->blocks + blockSize * (i + 1));
+		block->next = next;
+	}
+	P2DBlock* last = (P2DBlock*)((int8*)chunk->blocks + blockSize * (blockCount - 1));
+	last->next = m_freeLists[index];
+
+	m_freeLists[index] = chunk->blocks;
+	m_freeCounts[index] += blockCount;
+	++m_chunkCounts[index];
+	++m_chunkCount;
+}
+
+// Move a batch of blocks from the shared pool to a worker cache.
+void P2DBlockMem::Refill(P2DBlockCache* cache, int32 index)
+{
+	P2DScopedLock lock(&m_mutex);
+
+	for (int32 i = 0; i < BLOCK_BATCH_SIZE; ++i)
+	{
+		if (m_freeLists[index] == NULL)
+		{
+			AddChunk(index);
+		}
+
+		P2DBlock* block = m_freeLists[index];
+		m_freeLists[index] = block->next;
+		--m_freeCounts[index];
+
+		block->next = cache->freeLists[index];
+		cache->freeLists[index] = block;
+		++cache->counts[index];
+	}
+
+	int32 totalBlocks = m_chunkCounts[index] * (CHUNK_SIZE / s_blockSizes[index]);
+	m_peakBlocks[index] = P2DMax(m_peakBlocks[index], totalBlocks - m_freeCounts[index]);
+}
+
+// Take a single block from the shared pool, for threads without a cache.
+void* P2DBlockMem::AllocateShared(int32 index)
+{
+	P2DScopedLock lock(&m_mutex);
+
+	if (m_freeLists[index] == NULL)
+	{
+		AddChunk(index);
+	}
+
+	P2DBlock* block = m_freeLists[index];
+	m_freeLists[index] = block->next;
+	--m_freeCounts[index];
+	++m_sharedAllocations[index];
+
+	int32 totalBlocks = m_chunkCounts[index] * (CHUNK_SIZE / s_blockSizes[index]);
+	m_peakBlocks[index] = P2DMax(m_peakBlocks[index], totalBlocks - m_freeCounts[index]);
+	return block;
+}
+
+// Give a single block back to the shared pool.
+void P2DBlockMem::FreeShared(P2DBlock* block, int32 index)
+{
+	P2DScopedLock lock(&m_mutex);
+
+	block->next = m_freeLists[index];
+	m_freeLists[index] = block;
+	++m_freeCounts[index];
+}
+
+// Move blocks from a worker cache back to the shared pool.
+void P2DBlockMem::Flush(P2DBlockCache* cache, int32 index, int32 count)
+{
+	P2DScopedLock lock(&m_mutex);
+
+	for (int32 i = 0; i < count && cache->freeLists[index] != NULL; ++i)
+	{
+		P2DBlock* block = cache->freeLists[index];
+		cache->freeLists[index] = block->next;
+		--cache->counts[index];
+
+		block->next = m_freeLists[index];
+		m_freeLists[index] = block;
+		++m_freeCounts[index];
+	}
+}
+
+void* P2DBlockMem::Allocate(int32 size, P2DMemCategory category)
 {
 	if (size == 0)
 		return NULL;
@@ -148,53 +501,29 @@ void* P2DBlockMem::Allocate(int32 size)
 
 	if (size > MAX_BLOCK_SIZE)
 	{
-		return MemAlloc(size);
+		return MemAlloc(size, category);
 	}
 
 	int32 index = s_blockSizeLookup[size];
 	assert(0 <= index && index < BLOCK_SIZES);
 
-	if (m_freeLists[index])
+	int32 worker = P2DGetWorkerIndex();
+	if (worker == P2D_NO_WORKER)
 	{
-		P2DBlock* block = m_freeLists[index];
-		m_freeLists[index] = block->next;
-		return block;
+		return AllocateShared(index);
 	}
-	else
-	{
-		if (m_chunkCount == m_chunkSpace)
-		{
-			P2DChunk* oldChunks = m_chunks;
-			m_chunkSpace += CHUNK_ARRAY_INCREMENT;
-			m_chunks = (P2DChunk*)MemAlloc(m_chunkSpace * sizeof(P2DChunk));
-			memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(P2DChunk));
-			memset(m_chunks + m_chunkCount, 0, CHUNK_ARRAY_INCREMENT * sizeof(P2DChunk));
-			MemFree(oldChunks);
-		}
-
-		P2DChunk* chunk = m_chunks + m_chunkCount;
-		chunk->blocks = (P2DBlock*)MemAlloc(CHUNK_SIZE);
-#if defined(_DEBUG)
-		memset(chunk->blocks, 0xcd, CHUNK_SIZE);
-#endif
-		int32 blockSize = s_blockSizes[index];
-		chunk->blockSize = blockSize;
-		int32 blockCount = CHUNK_SIZE / blockSize;
-		assert(blockCount * blockSize <= CHUNK_SIZE);
-		for (int32 i = 0; i < blockCount - 1; ++i)
-		{
-			P2DBlock* block = (P2DBlock*)((int8*)chunk->blocks + blockSize * i);
-			P2DBlock* next = (P2DBlock*)((int8*)chunk->blocks + blockSize * (i + 1));
-			block->next = next;
-		}
-		P2DBlock* last = (P2DBlock*)((int8*)chunk->blocks + blockSize * (blockCount - 1));
-		last->next = NULL;
-
-		m_freeLists[index] = chunk->blocks->next;
-		++m_chunkCount;
 
-		return chunk->blocks;
+	P2DBlockCache* cache = m_caches + worker;
+	if (cache->freeLists[index] == NULL)
+	{
+		Refill(cache, index);
 	}
+
+	P2DBlock* block = cache->freeLists[index];
+	cache->freeLists[index] = block->next;
+	--cache->counts[index];
+	++cache->allocations[index];
+	return block;
 }
 
 void P2DBlockMem::Free(void* p, int32 size)
@@ -217,37 +546,58 @@ void P2DBlockMem::Free(void* p, int32 size)
 
 #ifdef _DEBUG
 	// Verify the memory address and size is valid.
-	int32 blockSize = s_blockSizes[index];
-	bool found = false;
-	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
-		P2DChunk* chunk = m_chunks + i;
-		if (chunk->blockSize != blockSize)
-		{
-			assert(	(int8*)p + blockSize <= (int8*)chunk->blocks ||
-						(int8*)chunk->blocks + CHUNK_SIZE <= (int8*)p);
-		}
-		else
+		P2DScopedLock lock(&m_mutex);
+		int32 blockSize = s_blockSizes[index];
+		bool found = false;
+		for (int32 i = 0; i < m_chunkCount; ++i)
 		{
-			if ((int8*)chunk->blocks <= (int8*)p && (int8*)p + blockSize <= (int8*)chunk->blocks + CHUNK_SIZE)
+			P2DChunk* chunk = m_chunks + i;
+			if (chunk->blockSize != blockSize)
 			{
-				found = true;
+				assert(	(int8*)p + blockSize <= (int8*)chunk->blocks ||
+							(int8*)chunk->blocks + CHUNK_SIZE <= (int8*)p);
+			}
+			else
+			{
+				if ((int8*)chunk->blocks <= (int8*)p && (int8*)p + blockSize <= (int8*)chunk->blocks + CHUNK_SIZE)
+				{
+					found = true;
+				}
 			}
 		}
-	}
 
-	assert(found);
+		assert(found);
 
-	memset(p, 0xfd, blockSize);
+		memset(p, 0xfd, blockSize);
+	}
 #endif
 
+	int32 worker = P2DGetWorkerIndex();
+	if (worker == P2D_NO_WORKER)
+	{
+		FreeShared((P2DBlock*)p, index);
+		return;
+	}
+
+	P2DBlockCache* cache = m_caches + worker;
 	P2DBlock* block = (P2DBlock*)p;
-	block->next = m_freeLists[index];
-	m_freeLists[index] = block;
+	block->next = cache->freeLists[index];
+	cache->freeLists[index] = block;
+	++cache->counts[index];
+
+	// Keep one batch around for the next allocations and hand the rest back,
+	// so a worker that mostly frees doesn't hoard blocks.
+	if (cache->counts[index] > 2 * BLOCK_BATCH_SIZE)
+	{
+		Flush(cache, index, cache->counts[index] - BLOCK_BATCH_SIZE);
+	}
 }
 
 void P2DBlockMem::Clear()
 {
+	P2DScopedLock lock(&m_mutex);
+
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
 		MemFree(m_chunks[i].blocks);
@@ -257,5 +607,163 @@ void P2DBlockMem::Clear()
 	memset(m_chunks, 0, m_chunkSpace * sizeof(P2DChunk));
 
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+	memset(m_freeCounts, 0, sizeof(m_freeCounts));
+	memset(m_chunkCounts, 0, sizeof(m_chunkCounts));
+
+	for (int32 i = 0; i < P2D_MAX_WORKERS; ++i)
+	{
+		memset(m_caches[i].freeLists, 0, sizeof(m_caches[i].freeLists));
+		memset(m_caches[i].counts, 0, sizeof(m_caches[i].counts));
+	}
+}
+
+static int P2DCompareChunks(const void* a, const void* b)
+{
+	const P2DChunk* ca = (const P2DChunk*)a;
+	const P2DChunk* cb = (const P2DChunk*)b;
+	if (ca->blocks < cb->blocks)
+	{
+		return -1;
+	}
+	return ca->blocks > cb->blocks ? 1 : 0;
 }
 
+// Find the chunk holding a block. The chunks must be sorted by address.
+static int32 P2DFindChunk(const P2DChunk* chunks, int32 count, const P2DBlock* block)
+{
+	int32 low = 0;
+	int32 high = count - 1;
+	while (low <= high)
+	{
+		int32 mid = (low + high) >> 1;
+		const int8* begin = (const int8*)chunks[mid].blocks;
+		if ((const int8*)block < begin)
+		{
+			high = mid - 1;
+		}
+		else if ((const int8*)block >= begin + CHUNK_SIZE)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return mid;
+		}
+	}
+
+	assert(false);
+	return -1;
+}
+
+int32 P2DBlockMem::Trim()
+{
+	for (int32 i = 0; i < P2D_MAX_WORKERS; ++i)
+	{
+		for (int32 j = 0; j < BLOCK_SIZES; ++j)
+		{
+			Flush(m_caches + i, j, m_caches[i].counts[j]);
+		}
+	}
+
+	P2DScopedLock lock(&m_mutex);
+
+	if (m_chunkCount == 0)
+	{
+		return 0;
+	}
+
+	qsort(m_chunks, m_chunkCount, sizeof(P2DChunk), P2DCompareChunks);
+
+	// Count the free blocks of every chunk.
+	int32* freeCounts = (int32*)MemAlloc(m_chunkCount * sizeof(int32));
+	memset(freeCounts, 0, m_chunkCount * sizeof(int32));
+	for (int32 i = 0; i < BLOCK_SIZES; ++i)
+	{
+		for (P2DBlock* block = m_freeLists[i]; block != NULL; block = block->next)
+		{
+			++freeCounts[P2DFindChunk(m_chunks, m_chunkCount, block)];
+		}
+	}
+
+	// Drop the blocks of the fully free chunks from the free lists, keeping the
+	// order of the others.
+	for (int32 i = 0; i < BLOCK_SIZES; ++i)
+	{
+		P2DBlock** link = m_freeLists + i;
+		while (*link != NULL)
+		{
+			int32 c = P2DFindChunk(m_chunks, m_chunkCount, *link);
+			if (freeCounts[c] == CHUNK_SIZE / m_chunks[c].blockSize)
+			{
+				*link = (*link)->next;
+				--m_freeCounts[i];
+			}
+			else
+			{
+				link = &(*link)->next;
+			}
+		}
+	}
+
+	int32 released = 0;
+	int32 count = 0;
+	for (int32 i = 0; i < m_chunkCount; ++i)
+	{
+		P2DChunk* chunk = m_chunks + i;
+		if (freeCounts[i] == CHUNK_SIZE / chunk->blockSize)
+		{
+			--m_chunkCounts[s_blockSizeLookup[chunk->blockSize]];
+			MemFree(chunk->blocks);
+			released += CHUNK_SIZE;
+		}
+		else
+		{
+			m_chunks[count++] = *chunk;
+		}
+	}
+
+	memset(m_chunks + count, 0, (m_chunkCount - count) * sizeof(P2DChunk));
+	m_chunkCount = count;
+
+	MemFree(freeCounts);
+	return released;
+}
+
+void P2DBlockMem::FlushWorker(int32 worker)
+{
+	assert(0 <= worker && worker < P2D_MAX_WORKERS);
+
+	LockAllocators();
+	for (P2DBlockMem* allocator = s_allocators; allocator != NULL; allocator = allocator->m_next)
+	{
+		P2DBlockCache* cache = allocator->m_caches + worker;
+		for (int32 i = 0; i < BLOCK_SIZES; ++i)
+		{
+			allocator->Flush(cache, i, cache->counts[i]);
+		}
+	}
+	UnlockAllocators();
+}
+
+P2DBlockStats P2DBlockMem::GetStats(int32 sizeClass) const
+{
+	assert(0 <= sizeClass && sizeClass < BLOCK_SIZES);
+
+	P2DBlockStats stats;
+	stats.blockSize = s_blockSizes[sizeClass];
+	stats.cachedBlocks = 0;
+	stats.allocationCount = 0;
+	for (int32 i = 0; i < P2D_MAX_WORKERS; ++i)
+	{
+		stats.cachedBlocks += m_caches[i].counts[sizeClass];
+		stats.allocationCount += m_caches[i].allocations[sizeClass];
+	}
+
+	P2DScopedLock lock(&m_mutex);
+	stats.allocationCount += m_sharedAllocations[sizeClass];
+	stats.chunkCount = m_chunkCounts[sizeClass];
+	stats.totalBlocks = m_chunkCounts[sizeClass] * (CHUNK_SIZE / stats.blockSize);
+	stats.usedBlocks = stats.totalBlocks - m_freeCounts[sizeClass] - stats.cachedBlocks;
+	stats.peakBlocks = m_peakBlocks[sizeClass];
+	return stats;
+}
@@ -2,27 +2,89 @@
 #define P2D_MEM_H
 
 #include "p2dparams.h"
+#include "p2dthread.h"
 #include <memory.h>
 #include <stdlib.h>
 
 const int32 STACK_SIZE = 100 * 1024;
 const int32 MAX_STACK_ENTRIES = 32;
+const int32 MAX_STACK_PAGES = 32;
 
-void* MemAlloc(int32 size);
+/// Tags for the heap traffic of the engine, so the memory of a big scene
+/// can be attributed to the subsystem that holds it.
+enum P2DMemCategory
+{
+	e_memGeneral = 0,		///< anything not listed below
+	e_memTreeNodes,			///< dynamic tree nodes
+	e_memPairBuffer,		///< broad-phase pair and move buffers
+	e_memShapes,			///< shapes too large for the block allocator
+	e_memBlocks,			///< block allocator chunks (proxies, small shapes, island data, ...)
+	e_memObjects,			///< body, fixture and contact pools
+	e_memStack,				///< stack allocator pages, i.e. per step fallback growth
+	e_memCategoryCount
+};
+
+/// Heap usage of one category.
+struct P2DMemStats
+{
+	int32 liveBytes;		///< the number of bytes currently allocated
+	int32 peakBytes;		///< the peak of liveBytes
+	int32 allocationCount;	///< the number of allocations so far
+};
+
+/// User allocator hooks. They may be called from several threads at once.
+typedef void* (*P2DMemAllocFcn)(int32 size, void* userData);
+typedef void (*P2DMemFreeFcn)(void* mem, void* userData);
+
+/// Route all engine heap traffic through the given functions, e.g. to use
+/// another malloc or a preallocated arena. Pass NULL to restore malloc/free.
+/// This must be done while the engine holds no heap memory, i.e. before the
+/// first scene is created or after the last one is destroyed.
+void SetMemHooks(P2DMemAllocFcn allocFcn, P2DMemFreeFcn freeFcn, void* userData);
+
+/// Get the heap usage of a category.
+P2DMemStats GetMemStats(P2DMemCategory category);
+
+/// Get the heap usage of all the categories together.
+P2DMemStats GetMemTotalStats();
+
+void* MemAlloc(int32 size, P2DMemCategory category = e_memGeneral);
 void MemFree(void* mem);
 
 
 // =======STACK=MEM=======
 struct P2DStackEntry
+{
+	char* data;
+	int32 size;		// the requested size
+	int32 used;		// the aligned size taken from the page
+	int32 page;
+};
+
+struct P2DStackPage
 {
 	char* data;
 	int32 size;
-	bool usedMalloc;
+	int32 index;
+};
+
+/// Stack allocator telemetry.
+struct P2DStackStats
+{
+	int32 maxAllocation;	///< the peak number of bytes in use at once
+	int32 reserved;			///< the number of bytes held in pages
+	int32 fallbackCount;	///< the number of times a step had to grow the arena
+	int32 maxEntryCount;	///< the peak number of nested allocations
 };
 
 // This is a stack allocator used for fast per step allocations.
 // You must nest allocate/free pairs. The code will assert
 // if you try to interleave multiple allocate/free pairs.
+// Memory comes from pages. When a step needs more than the current pages
+// hold a new, larger page is added. Once the stack is empty again the pages
+// are merged into one, so the arena keeps its peak size and later steps
+// don't touch the heap at all.
+// An instance is not thread safe, each worker thread needs its own.
 class P2DStackMem
 {
 public:
@@ -34,16 +96,28 @@ public:
 
 	int32 GetMaxAllocation() const;
 
+	/// Get the telemetry of this arena.
+	P2DStackStats GetStats() const;
+
 private:
 
-	char m_data[STACK_SIZE];
-	int32 m_index;
+	void AddPage(int32 size);
+	void GrowEntries();
+
+	P2DStackPage m_pages[MAX_STACK_PAGES];
+	int32 m_pageCount;
+	int32 m_currentPage;
+	int32 m_reserved;
 
 	int32 m_allocation;
 	int32 m_maxAllocation;
+	int32 m_fallbackCount;
 
-	P2DStackEntry m_entries[MAX_STACK_ENTRIES];
+	P2DStackEntry* m_entries;
+	P2DStackEntry m_entryArray[MAX_STACK_ENTRIES];
 	int32 m_entryCount;
+	int32 m_entryCapacity;
+	int32 m_maxEntryCount;
 };
 
 
@@ -52,6 +126,7 @@ const int32 CHUNK_SIZE = 16 * 1024;
 const int32 MAX_BLOCK_SIZE = 640;
 const int32 BLOCK_SIZES = 14;
 const int32 CHUNK_ARRAY_INCREMENT = 128;
+const int32 BLOCK_BATCH_SIZE = 32;
 
 struct P2DBlock
 {
@@ -64,32 +139,93 @@ struct P2DChunk
 	P2DBlock* blocks;
 };
 
+// The free lists owned by one worker thread.
+struct P2DBlockCache
+{
+	P2DBlock* freeLists[BLOCK_SIZES];
+	int32 counts[BLOCK_SIZES];
+	int32 allocations[BLOCK_SIZES];
+};
 
+/// Block allocator telemetry for one size class.
+struct P2DBlockStats
+{
+	int32 blockSize;		///< the size of the blocks in this class
+	int32 chunkCount;		///< the number of chunks carved into blocks of this size
+	int32 totalBlocks;		///< the number of blocks in those chunks
+	int32 usedBlocks;		///< the number of blocks handed out and not freed
+	int32 cachedBlocks;		///< the number of free blocks held by worker caches
+	int32 peakBlocks;		///< the peak number of blocks taken out of the shared pool
+	int32 allocationCount;	///< the number of allocations so far
+};
 
 /// This is a small object allocator used for allocating small
 /// objects that persist for more than one time step.
 /// See: http://www.codeproject.com/useritems/Small_Block_Allocator.asp
+/// Each worker thread (see P2DGetWorkerIndex) allocates from and frees to its
+/// own free lists without locking. The lists are refilled from, and flushed to,
+/// a shared pool of chunks in batches of BLOCK_BATCH_SIZE under a mutex.
+/// Threads without a worker index use the shared pool directly, under the mutex.
+/// A block may be freed by a different thread than the one that allocated it.
 class P2DBlockMem
 {
 public:
 	P2DBlockMem();
 	~P2DBlockMem();
 
-	/// Allocate memory. This will use MemAlloc if the size is larger than MAX_BLOCK_SIZE.
-	void* Allocate(int32 size);
+	/// Allocate memory. This will use MemAlloc if the size is larger than MAX_BLOCK_SIZE,
+	/// tagged with the given category.
+	void* Allocate(int32 size, P2DMemCategory category = e_memGeneral);
 
 	/// Free memory. This will use MemFree if the size is larger than MAX_BLOCK_SIZE.
 	void Free(void* p, int32 size);
 
+	/// Release all the chunks, every block becomes invalid.
+	/// No other thread may use the allocator during this call.
 	void Clear();
 
+	/// Return the worker caches to the shared pool and release the chunks that
+	/// have no block in use.
+	/// No other thread may use the allocator during this call.
+	/// @return the number of bytes released.
+	int32 Trim();
+
+	/// Get the telemetry of a size class. The numbers are only exact when no
+	/// other thread is using the allocator.
+	/// @param sizeClass in [0, BLOCK_SIZES)
+	P2DBlockStats GetStats(int32 sizeClass) const;
+
+	/// Return the caches of a worker to the shared pools of all the block
+	/// allocators. Only the thread holding the worker index may call this,
+	/// see P2DReleaseWorker.
+	static void FlushWorker(int32 worker);
+
 private:
 
+	void AddChunk(int32 index);
+	void Refill(P2DBlockCache* cache, int32 index);
+	void Flush(P2DBlockCache* cache, int32 index, int32 count);
+	void* AllocateShared(int32 index);
+	void FreeShared(P2DBlock* block, int32 index);
+
 	P2DChunk* m_chunks;
 	int32 m_chunkCount;
 	int32 m_chunkSpace;
 
+	// The shared pool, guarded by m_mutex.
 	P2DBlock* m_freeLists[BLOCK_SIZES];
+	int32 m_freeCounts[BLOCK_SIZES];
+	int32 m_chunkCounts[BLOCK_SIZES];
+	int32 m_peakBlocks[BLOCK_SIZES];
+	int32 m_sharedAllocations[BLOCK_SIZES];
+	mutable P2DMutex m_mutex;
+
+	P2DBlockCache m_caches[P2D_MAX_WORKERS];
+
+	// All the live allocators, so a released worker can flush its caches.
+	P2DBlockMem* m_prev;
+	P2DBlockMem* m_next;
+	static P2DBlockMem* s_allocators;
 
 	static int32 s_blockSizes[BLOCK_SIZES];
 	static uint8 s_blockSizeLookup[MAX_BLOCK_SIZE + 1];
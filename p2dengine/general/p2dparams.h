@@ -49,18 +49,75 @@
 /// Maximum number of sub-steps per contact in continuous physics simulation.
 #define P2D_MAX_SUB_STEPS 8
 
+/// A non-bullet body only gets continuous collision when it moves more than this
+/// fraction of its smallest extent in a time step. Slower bodies cannot tunnel.
+#define P2D_CCD_MOTION_FRACTION 0.5f
+
 /// This is used to fatten AABBs in the dynamic b-tree. This allows proxies
 /// to move by a small amount without triggering a tree adjustment.
+/// This is the margin of a new proxy, moved proxies adapt theirs to their motion.
 #define P2D_AABB_EXTENSION 0.1f
 
 /// This is used to fatten AABBs in the dynamic b-tree. This is used to predict
-/// the future position based on the current displacement.
-/// This is a dimensionless multiplier.
-#define P2D_AABB_MULTIPLIER 2.0f
+/// the future position based on the average displacement, see P2D_AABB_MAX_PREDICTION.
+/// This is a dimensionless multiplier, i.e. the number of moves predicted.
+#define P2D_AABB_MULTIPLIER 16.0f
+
+/// The margin of a moved proxy covers this many steps of its average motion.
+#define P2D_AABB_MARGIN_STEPS 4.0f
+
+/// The smallest margin of a moved proxy. This absorbs the jitter of resting bodies.
+#define P2D_AABB_MIN_EXTENSION (4.0f * P2D_LINEAR_SLOP)
+
+/// The largest margin of a moved proxy. This bounds the false positive pairs of
+/// fast proxies.
+#define P2D_AABB_MAX_EXTENSION P2D_AABB_EXTENSION
+
+/// The longest predicted displacement of a moved proxy. This bounds the
+/// false positive pairs of fast proxies along their path.
+#define P2D_AABB_MAX_PREDICTION (10.0f * P2D_AABB_EXTENSION)
+
+/// The shortest predicted displacement of a proxy that moves steadily. Slow
+/// proxies would otherwise leave their fat AABB every few moves.
+#define P2D_AABB_MIN_PREDICTION P2D_AABB_EXTENSION
+
+/// The weight of the latest displacement in a proxy's average motion.
+#define P2D_AABB_MOTION_SMOOTHING 0.25f
+
+/// A proxy whose fat AABB has more than this many times the margin it needs
+/// is shrunk, even if it did not leave its fat AABB.
+#define P2D_AABB_SHRINK_RATIO 4.0f
+
+/// A proxy is only shrunk after its fat AABB was too large for this many moves
+/// in a row. Settling bodies keep their margin until they are really at rest.
+#define P2D_AABB_SHRINK_MOVES 30
+
+/// The number of leaves of the dynamic b-tree re-inserted per time step to
+/// keep the tree from degrading. See P2DScene::SetTreeRebalanceBudget.
+#define P2D_TREE_REBALANCE_BUDGET 4
+
+/// The number of leaves sampled for each leaf re-inserted by the rebalancing.
+#define P2D_TREE_REBALANCE_SAMPLES 4
+
+/// The number of rays traversing the dynamic b-tree together in a batched ray-cast.
+#define P2D_RAY_PACKET_SIZE 8
+
+/// The number of collision layers. A layer is a fixture's index into the
+/// scene's layer collision matrix.
+#define P2D_MAX_LAYERS 16
 
 /// Maximum number of contacts to be handled to solve a TOI impact.
 #define P2D_MAX_TOI_CONTACTS 32
 
+/// The number of bins of the TOI root finder histogram in P2DProfile. Bin 0
+/// counts the TOI queries that needed no root finding, bin i the ones that
+/// took 2^(i-1) to 2^i - 1 root iterations. The last bin takes the rest.
+#define P2D_TOI_ROOT_HISTOGRAM_BINS 8
+
+/// The number of time steps the impulses of a lost contact point are kept for
+/// warm starting, in case the point comes back.
+#define P2D_IMPULSE_CACHE_STEPS 4
+
 /// A velocity threshold for elastic collisions. Any collision with a relative linear
 /// velocity below this threshold will be treated as inelastic.
 #define P2D_VELOCITY_THRESHOLD 1.0f
@@ -71,6 +128,21 @@
 #define P2D_BAUMGARTE 0.2f
 #define P2D_TOI_BAUMGARTE 0.75f
 
+/// The default number of sub-steps per time step for the soft step solver.
+#define P2D_SOFT_SUB_STEPS 4
+
+/// The stiffness of soft contacts in cycles per second. This is further limited
+/// to a quarter of the sub-step rate.
+#define P2D_SOFT_CONTACT_HERTZ 30.0f
+
+/// The damping ratio of soft contacts. Contacts are heavily over-damped so they
+/// don't bounce.
+#define P2D_SOFT_CONTACT_DAMPING_RATIO 10.0f
+
+/// The maximum velocity used by soft contacts to push out overlapping shapes, in
+/// meters per second.
+#define P2D_SOFT_CONTACT_PUSHOUT 3.0f
+
 /// The maximum linear position correction used when solving constraints. This helps to
 /// prevent overshoot.
 #define P2D_MAX_LINEAR_CORRECTION 0.2f
@@ -88,6 +160,12 @@
 #define P2D_MAX_ROTATION_SQUARED (P2D_MAX_ROTATION * P2D_MAX_ROTATION)
 
 
+// Threading
+
+/// The maximum number of worker threads that get their own per step allocators.
+#define P2D_MAX_WORKERS 8
+
+
 // timing
 
 /// A body cannot sleep if its linear velocity is above this tolerance.
@@ -99,6 +177,14 @@
 /// The time that a body must be still before it will go to sleep.
 #define P2D_TIME_TO_SLEEP 0.5f
 
+/// A body whose origin moved less than this since its proxies were last
+/// synchronized keeps its proxies. This must stay well below P2D_AABB_EXTENSION.
+#define P2D_LINEAR_SYNC_TOLERANCE (0.05f * P2D_LINEAR_SLOP)
+
+/// A body whose angle changed less than this since its proxies were last
+/// synchronized keeps its proxies.
+#define P2D_ANGULAR_SYNC_TOLERANCE (0.05f * P2D_ANGULAR_SLOP)
+
 
 
 typedef unsigned char uint8;
@@ -0,0 +1,133 @@
+#include "p2dpool.h"
+
+const int32 POOL_NULL_SLOT = -1;
+const uint32 POOL_INDEX_MASK = (1u << POOL_INDEX_BITS) - 1;
+const uint32 POOL_MAX_GENERATION = (1u << (32 - POOL_INDEX_BITS)) - 1;
+
+P2DPool::P2DPool(int32 elementSize, P2DMemCategory category)
+{
+	assert(elementSize > 0);
+	assert(sizeof(P2DPoolSlot) == 8);
+
+	m_elementSize = elementSize;
+	m_stride = (int32)sizeof(P2DPoolSlot) + ((elementSize + 7) & ~7);
+	m_category = category;
+
+	m_pageSpace = POOL_PAGE_ARRAY_INCREMENT;
+	m_pageCount = 0;
+	m_pages = (int8**)MemAlloc(m_pageSpace * sizeof(int8*), m_category);
+
+	m_slotCount = 0;
+	m_freeList = POOL_NULL_SLOT;
+	m_count = 0;
+}
+
+P2DPool::~P2DPool()
+{
+	for (int32 i = 0; i < m_pageCount; ++i)
+	{
+		MemFree(m_pages[i]);
+	}
+
+	MemFree(m_pages);
+}
+
+void P2DPool::AddPage()
+{
+	if (m_pageCount == m_pageSpace)
+	{
+		int8** oldPages = m_pages;
+		m_pageSpace += POOL_PAGE_ARRAY_INCREMENT;
+		m_pages = (int8**)MemAlloc(m_pageSpace * sizeof(int8*), m_category);
+		memcpy(m_pages, oldPages, m_pageCount * sizeof(int8*));
+		MemFree(oldPages);
+	}
+
+	m_pages[m_pageCount] = (int8*)MemAlloc(POOL_PAGE_SLOTS * m_stride, m_category);
+#if defined(_DEBUG)
+	memset(m_pages[m_pageCount], 0xcd, POOL_PAGE_SLOTS * m_stride);
+#endif
+	++m_pageCount;
+}
+
+void* P2DPool::Allocate(int32 size)
+{
+	assert(0 < size && size <= m_elementSize);
+	NOT_USED(size);
+
+	int32 index;
+	P2DPoolSlot* slot;
+	if (m_freeList != POOL_NULL_SLOT)
+	{
+		index = m_freeList;
+		slot = GetSlotHeader(index);
+		m_freeList = slot->next;
+	}
+	else
+	{
+		// Out of handle bits.
+		assert((uint32)m_slotCount <= POOL_INDEX_MASK);
+
+		if (m_slotCount == m_pageCount * POOL_PAGE_SLOTS)
+		{
+			AddPage();
+		}
+
+		index = m_slotCount;
+		++m_slotCount;
+
+		// Generations start at one so no handle equals P2D_NULL_HANDLE.
+		slot = GetSlotHeader(index);
+		slot->handle = (1u << POOL_INDEX_BITS) | (uint32)index;
+	}
+
+	slot->next = POOL_SLOT_USED;
+	++m_count;
+
+	return slot + 1;
+}
+
+void P2DPool::Free(void* p)
+{
+	if (p == NULL)
+	{
+		return;
+	}
+
+	P2DPoolSlot* slot = (P2DPoolSlot*)p - 1;
+	int32 index = (int32)(slot->handle & POOL_INDEX_MASK);
+	assert(0 <= index && index < m_slotCount);
+	assert(GetSlotHeader(index) == slot);
+	assert(slot->next == POOL_SLOT_USED);
+
+#if defined(_DEBUG)
+	memset(p, 0xfd, m_elementSize);
+#endif
+
+	// Bump the generation so outstanding handles go stale.
+	uint32 generation = slot->handle >> POOL_INDEX_BITS;
+	generation = generation == POOL_MAX_GENERATION ? 1 : generation + 1;
+	slot->handle = (generation << POOL_INDEX_BITS) | (uint32)index;
+
+	slot->next = m_freeList;
+	m_freeList = index;
+	--m_count;
+}
+
+void* P2DPool::Get(P2DHandle handle) const
+{
+	int32 index = (int32)(handle & POOL_INDEX_MASK);
+	if (handle == P2D_NULL_HANDLE || index >= m_slotCount)
+	{
+		return NULL;
+	}
+
+	P2DPoolSlot* slot = GetSlotHeader(index);
+	if (slot->handle != handle || slot->next != POOL_SLOT_USED)
+	{
+		return NULL;
+	}
+
+	return slot + 1;
+}
+
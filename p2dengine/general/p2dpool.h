@@ -0,0 +1,127 @@
+#ifndef P2D_POOL_H
+#define P2D_POOL_H
+
+#include "p2dparams.h"
+#include "p2dmem.h"
+
+/// A handle to a pooled object. The low POOL_INDEX_BITS bits are the slot
+/// index, the high bits the generation of the slot. A slot's generation changes
+/// every time its object is freed, so a handle to a destroyed object is
+/// detected instead of aliasing whatever reuses the slot.
+typedef uint32 P2DHandle;
+
+/// A handle that never refers to an object.
+const P2DHandle P2D_NULL_HANDLE = 0;
+
+const int32 POOL_INDEX_BITS = 20;
+const int32 POOL_PAGE_SLOTS = 128;
+const int32 POOL_PAGE_ARRAY_INCREMENT = 16;
+const int32 POOL_SLOT_USED = -2;
+
+struct P2DPoolSlot
+{
+	P2DHandle handle;
+	int32 next;		// the next free slot, or POOL_SLOT_USED
+};
+
+/// This is a pool of fixed size objects with generational handles.
+/// Objects live in pages of POOL_PAGE_SLOTS slots, so they never move and
+/// iterating the slots in index order walks memory front to back.
+/// Freed slots are reused before new ones are carved.
+/// A pool is not thread safe.
+class P2DPool
+{
+public:
+	/// @param elementSize the size of the largest object stored in the pool.
+	P2DPool(int32 elementSize, P2DMemCategory category);
+	~P2DPool();
+
+	/// Allocate memory for an object. Construct it with placement new.
+	void* Allocate(int32 size);
+
+	/// Free the memory of an object. Destruct it first. This invalidates its handle.
+	void Free(void* p);
+
+	/// Get an object from its handle.
+	/// @return NULL if the object was freed.
+	void* Get(P2DHandle handle) const;
+
+	/// Get the handle of an object allocated from a pool.
+	static P2DHandle GetHandle(const void* p);
+
+	/// Get the slot index of a handle.
+	static int32 GetIndex(P2DHandle handle);
+
+	/// Get the number of live objects.
+	int32 GetCount() const;
+
+	/// Get the number of slots carved so far. Slot indices are in [0, count).
+	int32 GetSlotCount() const;
+
+	/// Get the object in a slot, in memory order.
+	/// @return NULL if the slot is free.
+	void* GetSlot(int32 index) const;
+
+private:
+
+	P2DPoolSlot* GetSlotHeader(int32 index) const;
+	void AddPage();
+
+	int8** m_pages;
+	int32 m_pageCount;
+	int32 m_pageSpace;
+
+	int32 m_elementSize;
+	int32 m_stride;
+	P2DMemCategory m_category;
+
+	int32 m_slotCount;
+	int32 m_freeList;
+	int32 m_count;
+};
+
+inline P2DPoolSlot* P2DPool::GetSlotHeader(int32 index) const
+{
+	return (P2DPoolSlot*)(m_pages[index / POOL_PAGE_SLOTS] + (index % POOL_PAGE_SLOTS) * m_stride);
+}
+
+inline void* P2DPool::GetSlot(int32 index) const
+{
+	assert(0 <= index && index < m_slotCount);
+
+	P2DPoolSlot* slot = GetSlotHeader(index);
+	if (slot->next != POOL_SLOT_USED)
+	{
+		return NULL;
+	}
+
+	return slot + 1;
+}
+
+inline P2DHandle P2DPool::GetHandle(const void* p)
+{
+	if (p == NULL)
+	{
+		return P2D_NULL_HANDLE;
+	}
+
+	const P2DPoolSlot* slot = (const P2DPoolSlot*)p - 1;
+	return slot->handle;
+}
+
+inline int32 P2DPool::GetIndex(P2DHandle handle)
+{
+	return (int32)(handle & ((1u << POOL_INDEX_BITS) - 1));
+}
+
+inline int32 P2DPool::GetCount() const
+{
+	return m_count;
+}
+
+inline int32 P2DPool::GetSlotCount() const
+{
+	return m_slotCount;
+}
+
+#endif
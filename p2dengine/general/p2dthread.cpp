@@ -0,0 +1,174 @@
+#include "p2dthread.h"
+#include "p2dmem.h"
+
+#define P2D_UNASSIGNED_WORKER (-2)
+
+static P2D_THREAD_LOCAL int32 s_workerIndex = P2D_UNASSIGNED_WORKER;
+
+// One bit per worker index, set while a thread holds it.
+static volatile int32 s_workerSlots = 0;
+
+int32 P2DGetWorkerIndex()
+{
+	if (s_workerIndex < 0)
+	{
+		// Claim the lowest free index. The slots start as a guess, a failed
+		// exchange tells the real ones. A thread without an index tries again
+		// on every call, it holds nothing that would have to move over.
+		s_workerIndex = P2D_NO_WORKER;
+		int32 slots = 0;
+		for (;;)
+		{
+			int32 index = 0;
+			while (index < P2D_MAX_WORKERS && (slots & (1 << index)) != 0)
+			{
+				++index;
+			}
+
+			if (index == P2D_MAX_WORKERS)
+			{
+				break;
+			}
+
+			int32 previous = P2DAtomicCompareExchange(&s_workerSlots, slots, slots | (1 << index));
+			if (previous == slots)
+			{
+				s_workerIndex = index;
+				break;
+			}
+			slots = previous;
+		}
+	}
+	return s_workerIndex;
+}
+
+void P2DReleaseWorker()
+{
+	int32 index = s_workerIndex;
+	s_workerIndex = P2D_UNASSIGNED_WORKER;
+	if (index < 0)
+	{
+		return;
+	}
+
+	// The caches must be empty before the next thread takes the index over.
+	P2DBlockMem::FlushWorker(index);
+
+	int32 slots = 1 << index;
+	for (;;)
+	{
+		int32 previous = P2DAtomicCompareExchange(&s_workerSlots, slots, slots & ~(1 << index));
+		if (previous == slots)
+		{
+			break;
+		}
+		slots = previous;
+	}
+}
+
+#if defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+P2DMutex::P2DMutex()
+{
+	CRITICAL_SECTION* cs = (CRITICAL_SECTION*)MemAlloc(sizeof(CRITICAL_SECTION));
+	InitializeCriticalSection(cs);
+	m_handle = cs;
+}
+
+P2DMutex::~P2DMutex()
+{
+	CRITICAL_SECTION* cs = (CRITICAL_SECTION*)m_handle;
+	DeleteCriticalSection(cs);
+	MemFree(cs);
+}
+
+void P2DMutex::Lock()
+{
+	EnterCriticalSection((CRITICAL_SECTION*)m_handle);
+}
+
+void P2DMutex::Unlock()
+{
+	LeaveCriticalSection((CRITICAL_SECTION*)m_handle);
+}
+
+int32 P2DAtomicAdd(volatile int32* value, int32 delta)
+{
+	return (int32)InterlockedExchangeAdd((volatile LONG*)value, (LONG)delta) + delta;
+}
+
+int32 P2DAtomicCompareExchange(volatile int32* value, int32 expected, int32 desired)
+{
+	return (int32)InterlockedCompareExchange((volatile LONG*)value, (LONG)desired, (LONG)expected);
+}
+
+void P2DAtomicMax(volatile int32* value, int32 candidate)
+{
+	LONG current = *value;
+	while (current < candidate)
+	{
+		LONG previous = InterlockedCompareExchange((volatile LONG*)value, (LONG)candidate, current);
+		if (previous == current)
+		{
+			break;
+		}
+		current = previous;
+	}
+}
+
+#else
+
+#include <pthread.h>
+
+P2DMutex::P2DMutex()
+{
+	pthread_mutex_t* mutex = (pthread_mutex_t*)MemAlloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init(mutex, NULL);
+	m_handle = mutex;
+}
+
+P2DMutex::~P2DMutex()
+{
+	pthread_mutex_t* mutex = (pthread_mutex_t*)m_handle;
+	pthread_mutex_destroy(mutex);
+	MemFree(mutex);
+}
+
+void P2DMutex::Lock()
+{
+	pthread_mutex_lock((pthread_mutex_t*)m_handle);
+}
+
+void P2DMutex::Unlock()
+{
+	pthread_mutex_unlock((pthread_mutex_t*)m_handle);
+}
+
+int32 P2DAtomicAdd(volatile int32* value, int32 delta)
+{
+	return __sync_add_and_fetch(value, delta);
+}
+
+int32 P2DAtomicCompareExchange(volatile int32* value, int32 expected, int32 desired)
+{
+	return __sync_val_compare_and_swap(value, expected, desired);
+}
+
+void P2DAtomicMax(volatile int32* value, int32 candidate)
+{
+	int32 current = *value;
+	while (current < candidate)
+	{
+		int32 previous = __sync_val_compare_and_swap(value, current, candidate);
+		if (previous == current)
+		{
+			break;
+		}
+		current = previous;
+	}
+}
+
+#endif
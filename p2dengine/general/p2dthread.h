@@ -0,0 +1,72 @@
+#ifndef P2D_THREAD_H
+#define P2D_THREAD_H
+
+#include "p2dparams.h"
+
+/// Declare a variable with one instance per thread. Only plain data
+/// (integers, pointers) can be thread local.
+#if defined(_WIN32)
+#define P2D_THREAD_LOCAL __declspec(thread)
+#else
+#define P2D_THREAD_LOCAL __thread
+#endif
+
+/// A non-recursive mutex.
+class P2DMutex
+{
+public:
+	P2DMutex();
+	~P2DMutex();
+
+	void Lock();
+	void Unlock();
+
+private:
+	P2DMutex(const P2DMutex&);
+	P2DMutex& operator=(const P2DMutex&);
+
+	void* m_handle;
+};
+
+/// Locks a mutex for the lifetime of the lock.
+class P2DScopedLock
+{
+public:
+	explicit P2DScopedLock(P2DMutex* mutex) : m_mutex(mutex) { m_mutex->Lock(); }
+	~P2DScopedLock() { m_mutex->Unlock(); }
+
+private:
+	P2DScopedLock(const P2DScopedLock&);
+	P2DScopedLock& operator=(const P2DScopedLock&);
+
+	P2DMutex* m_mutex;
+};
+
+/// The worker index of a thread that did not get one of its own.
+#define P2D_NO_WORKER (-1)
+
+/// Get the worker index of the calling thread. Per worker resources such as
+/// allocator caches are picked with it. A thread gets a free index the first
+/// time it asks and keeps it until it calls P2DReleaseWorker. While all
+/// P2D_MAX_WORKERS indices are taken a thread gets P2D_NO_WORKER and has to
+/// use the shared resources, it gets an index once one is released.
+int32 P2DGetWorkerIndex();
+
+/// Give the worker index of the calling thread back, so another thread can
+/// take it. The thread's block allocator caches are returned to their shared
+/// pools first. Call this before a thread that used the engine exits, it may
+/// ask for a new index afterwards.
+void P2DReleaseWorker();
+
+/// Atomically add to an integer.
+/// @return the new value.
+int32 P2DAtomicAdd(volatile int32* value, int32 delta);
+
+/// Atomically replace an integer if it holds the expected value.
+/// @return the value it held before.
+int32 P2DAtomicCompareExchange(volatile int32* value, int32 expected, int32 desired);
+
+/// Atomically raise an integer to at least the given value.
+void P2DAtomicMax(volatile int32* value, int32 candidate);
+
+#endif
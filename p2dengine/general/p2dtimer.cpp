@@ -62,7 +62,10 @@ float32 P2DTimer::GetMilliseconds() const
 {
     timeval t;
     gettimeofday(&t, 0);
-    return 1000.0f * (t.tv_sec - m_start_sec) + 0.001f * (t.tv_usec - m_start_usec);
+    // The fields are unsigned, so take the differences in floating point
+    // or a smaller tv_usec than at the start wraps around.
+    return float32(1000.0 * (float64(t.tv_sec) - float64(m_start_sec))
+                   + 0.001 * (float64(t.tv_usec) - float64(m_start_usec)));
 }
 
 #else
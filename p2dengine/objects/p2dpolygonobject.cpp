@@ -12,7 +12,7 @@
 
 P2DBaseObject* P2DPolygonObject::Clone(P2DBlockMem* allocator) const
 {
-    void* mem = allocator->Allocate(sizeof(P2DPolygonObject));
+    void* mem = allocator->Allocate(sizeof(P2DPolygonObject), e_memShapes);
     P2DPolygonObject* clone = new (mem) P2DPolygonObject;
 	*clone = *this;
 	return clone;
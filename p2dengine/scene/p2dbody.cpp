@@ -2,6 +2,7 @@
 #include "p2dfixture.h"
 #include "p2dscenemanager.h"
 #include "../collision/p2dcontact.h"
+#include "../objects/p2dpolygonobject.h"
 //#include "p2djoint.h"
 
 P2DBody::P2DBody(const P2DBodyDef* bd, P2DScene* world)
@@ -48,6 +49,9 @@ P2DBody::P2DBody(const P2DBodyDef* bd, P2DScene* world)
 	m_sweep.a = bd->angle;
 	m_sweep.alpha0 = 0.0f;
 
+	m_syncPosition = m_xf.position;
+	m_syncAngle = bd->angle;
+
     //ying m_jointList = NULL;
 	m_contactList = NULL;
 	m_prev = NULL;
@@ -65,6 +69,9 @@ P2DBody::P2DBody(const P2DBodyDef* bd, P2DScene* world)
 
 	m_sleepTime = 0.0f;
 
+	m_minExtent = 0.0f;
+	m_maxExtent = 0.0f;
+
 	m_type = bd->type;
 
     if (m_type == P2D_DYNAMIC_BODY)
@@ -155,7 +162,7 @@ P2DFixture* P2DBody::CreateFixture(const P2DFixtureDef* def)
 
     P2DBlockMem* allocator = &m_world->m_blockAllocator;
 
-    void* memory = allocator->Allocate(sizeof(P2DFixture));
+    void* memory = m_world->m_fixturePool.Allocate(sizeof(P2DFixture));
     P2DFixture* fixture = new (memory) P2DFixture;
 	fixture->Create(allocator, this, def);
 
@@ -171,6 +178,8 @@ P2DFixture* P2DBody::CreateFixture(const P2DFixtureDef* def)
 
 	fixture->m_body = this;
 
+	ComputeExtents();
+
 	// Adjust mass properties if needed.
 	if (fixture->m_density > 0.0f)
 	{
@@ -248,18 +257,65 @@ void P2DBody::DestroyFixture(P2DFixture* fixture)
         fixture->DestroyProxies(coarseCollision);
 	}
 
+	m_world->m_contactManager.m_impulseCache.Purge(fixture);
+
 	fixture->Destroy(allocator);
 	fixture->m_body = NULL;
 	fixture->m_next = NULL;
     fixture->~P2DFixture();
-    allocator->Free(fixture, sizeof(P2DFixture));
+    m_world->m_fixturePool.Free(fixture);
 
 	--m_fixtureCount;
 
+	ComputeExtents();
+
 	// Reset the mass data.
 	ResetMassData();
 }
 
+void P2DBody::ComputeExtents()
+{
+	const P2DVec2& center = m_sweep.localCenter;
+	m_minExtent = FLT_MAX;
+	m_maxExtent = 0.0f;
+	for (P2DFixture* f = m_fixtureList; f; f = f->m_next)
+	{
+		const P2DBaseObject* shape = f->GetShape();
+		if (shape->GetType() == P2DBaseObject::PolygonType)
+		{
+			// The smallest distance from the centroid to an edge is a lower bound
+			// on the half thickness of a convex polygon.
+			const P2DPolygonObject* poly = (const P2DPolygonObject*)shape;
+			for (int32 i = 0; i < poly->m_count; ++i)
+			{
+				float32 d = P2DVecDot(poly->m_normals[i], poly->m_vertices[i] - poly->m_centroid);
+				m_minExtent = P2DMin(m_minExtent, d + poly->m_radius);
+				m_maxExtent = P2DMax(m_maxExtent, P2DDistance(poly->m_vertices[i], center) + poly->m_radius);
+			}
+		}
+		else
+		{
+			m_minExtent = P2DMin(m_minExtent, shape->m_radius);
+
+			// Bound other shapes by the corners of their local boxes.
+            P2DTransform xf;
+			xf.SetIdentity();
+			for (int32 child = 0; child < shape->GetChildCount(); ++child)
+			{
+                P2DAABB aabb;
+				shape->ComputeAABB(&aabb, xf, child);
+                P2DVec2 farthest = P2DMax(P2DAbs(aabb.lowerBound - center), P2DAbs(aabb.upperBound - center));
+				m_maxExtent = P2DMax(m_maxExtent, farthest.Length());
+			}
+		}
+	}
+
+	if (m_minExtent == FLT_MAX)
+	{
+		m_minExtent = 0.0f;
+	}
+}
+
 void P2DBody::ResetMassData()
 {
 	// Compute mass data from shapes. Each shape has its own density.
@@ -275,6 +331,7 @@ void P2DBody::ResetMassData()
         m_sweep.c0 = m_xf.position;
         m_sweep.c = m_xf.position;
 		m_sweep.a0 = m_sweep.a;
+		ComputeExtents();
 		return;
 	}
 
@@ -330,6 +387,8 @@ void P2DBody::ResetMassData()
 
 	// Update center of mass velocity.
     m_linearVelocity += P2DVecCross(m_angularVelocity, m_sweep.c - oldCenter);
+
+	ComputeExtents();
 }
 
 void P2DBody::SetMassData(const P2DMass* massData)
@@ -371,6 +430,8 @@ void P2DBody::SetMassData(const P2DMass* massData)
 
 	// Update center of mass velocity.
     m_linearVelocity += P2DVecCross(m_angularVelocity, m_sweep.c - oldCenter);
+
+	ComputeExtents();
 }
 
 bool P2DBody::ShouldCollide(const P2DBody* other) const
@@ -415,15 +476,22 @@ void P2DBody::SetTransform(const P2DVec2& position, float32 angle)
 	m_sweep.c0 = m_sweep.c;
 	m_sweep.a0 = angle;
 
+	// A jump is not motion, keep it out of the proxies' motion averages.
     P2DCoarseCollision* coarseCollision = &m_world->m_contactManager.m_broadPhase;
     for (P2DFixture* f = m_fixtureList; f; f = f->m_next)
 	{
-        f->Synchronize(coarseCollision, m_xf, m_xf);
+        f->Synchronize(coarseCollision, m_xf, m_xf, true);
 	}
+
+	m_syncPosition = m_xf.position;
+	m_syncAngle = m_sweep.a;
 }
 
 void P2DBody::SynchronizeFixtures()
 {
+	m_syncPosition = m_xf.position;
+	m_syncAngle = m_sweep.a;
+
     P2DTransform xf1;
     xf1.rotation.Set(m_sweep.a0);
     xf1.position = m_sweep.c0 - P2DMul(xf1.rotation, m_sweep.localCenter);
@@ -435,6 +503,17 @@ void P2DBody::SynchronizeFixtures()
 	}
 }
 
+bool P2DBody::IsSyncRequired() const
+{
+	P2DVec2 d = m_xf.position - m_syncPosition;
+	if (d.LengthSquared() > P2D_LINEAR_SYNC_TOLERANCE * P2D_LINEAR_SYNC_TOLERANCE)
+	{
+		return true;
+	}
+
+	return P2DAbs(m_sweep.a - m_syncAngle) > P2D_ANGULAR_SYNC_TOLERANCE;
+}
+
 void P2DBody::SetActive(bool flag)
 {
     assert(m_world->IsLocked() == false);
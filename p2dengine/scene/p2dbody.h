@@ -3,6 +3,7 @@
 
 #include "../general/p2dmath.h"
 #include "../objects/p2dbaseobject.h"
+#include "../general/p2dpool.h"
 #include <memory>
 
 class P2DFixture;
@@ -368,6 +369,10 @@ public:
     P2DScene* GetWorld();
     const P2DScene* GetWorld() const;
 
+	/// Get the handle of this body. Unlike a pointer it can be kept after the body
+	/// is destroyed, P2DScene::GetBody then returns NULL.
+	P2DHandle GetHandle() const;
+
 	/// Dump this body to a log file
 	void Dump();
 
@@ -402,7 +407,8 @@ private:
 		e_bulletFlag		= 0x0008,
 		e_fixedRotationFlag	= 0x0010,
 		e_activeFlag		= 0x0020,
-		e_toiFlag			= 0x0040
+		e_toiFlag			= 0x0040,
+		e_fastFlag			= 0x0080
 	};
 
     P2DBody(const P2DBodyDef* bd, P2DScene *world);
@@ -411,6 +417,13 @@ private:
 	void SynchronizeFixtures();
 	void SynchronizeTransform();
 
+	// Did the body move since its fixtures were last synchronized?
+	bool IsSyncRequired() const;
+
+	// Compute m_minExtent and m_maxExtent from the attached fixtures and the
+	// center of mass.
+	void ComputeExtents();
+
 	// This is used to prevent connected bodies from colliding.
 	// It may lie, depending on the collideConnected flag.
 	bool ShouldCollide(const P2DBody* other) const;
@@ -426,6 +439,10 @@ private:
 	P2DTransform m_xf;		// the body origin transform
 	P2DSweep m_sweep;		// the swept motion for CCD
 
+	// The origin and angle the proxies were last synchronized to.
+	P2DVec2 m_syncPosition;
+	float32 m_syncAngle;
+
 	P2DVec2 m_linearVelocity;
 	float32 m_angularVelocity;
 
@@ -453,6 +470,13 @@ private:
 
 	float32 m_sleepTime;
 
+	// The smallest half thickness of the fixtures, measured from the centroid
+	// of each shape, and the largest distance from the center of mass to a
+	// fixture point. Used to decide if the body moves fast enough to need
+	// continuous collision.
+	float32 m_minExtent;
+	float32 m_maxExtent;
+
 	void* m_userData;
 };
 
@@ -848,4 +872,9 @@ inline const P2DScene* P2DBody::GetWorld() const
 	return m_world;
 }
 
+inline P2DHandle P2DBody::GetHandle() const
+{
+	return P2DPool::GetHandle(this);
+}
+
 #endif
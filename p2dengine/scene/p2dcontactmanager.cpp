@@ -9,13 +9,19 @@ P2DContactListener defaultListener;
 
 P2DContactManager::P2DContactManager()
 {
-	m_contactList = NULL;
 	m_contactCount = 0;
+	m_contactCapacity = 16;
+	m_contacts = (P2DContact**)MemAlloc(m_contactCapacity * sizeof(P2DContact*), e_memObjects);
 	m_contactFilter = &defaultFilter;
 	m_contactListener = &defaultListener;
 	m_allocator = NULL;
 }
 
+P2DContactManager::~P2DContactManager()
+{
+	MemFree(m_contacts);
+}
+
 void P2DContactManager::Destroy(P2DContact* c)
 {
 	P2DFixture* fixtureA = c->GetFixtureA();
@@ -28,21 +34,13 @@ void P2DContactManager::Destroy(P2DContact* c)
 		m_contactListener->EndContact(c);
 	}
 
-	// Remove from the world.
-	if (c->m_prev)
-	{
-		c->m_prev->m_next = c->m_next;
-	}
-
-	if (c->m_next)
-	{
-		c->m_next->m_prev = c->m_prev;
-	}
-
-	if (c == m_contactList)
-	{
-		m_contactList = c->m_next;
-	}
+	// Remove from the world. Fill the hole with the last contact.
+	int32 index = c->m_arrayIndex;
+	assert(0 <= index && index < m_contactCount && m_contacts[index] == c);
+	P2DContact* last = m_contacts[m_contactCount - 1];
+	m_contacts[index] = last;
+	last->m_arrayIndex = index;
+	c->m_arrayIndex = -1;
 
 	// Remove from body 1
 	if (c->m_nodeA.prev)
@@ -76,6 +74,12 @@ void P2DContactManager::Destroy(P2DContact* c)
 		bodyB->m_contactList = c->m_nodeB.next;
 	}
 
+	// Keep the impulses around in case the pair comes back soon.
+	if (c->IsTouching())
+	{
+		m_impulseCache.Store(c);
+	}
+
 	// Call the factory.
 	P2DContact::Destroy(c, m_allocator);
 	--m_contactCount;
@@ -86,10 +90,15 @@ void P2DContactManager::Destroy(P2DContact* c)
 // contact list.
 void P2DContactManager::Collide()
 {
-	// Update awake contacts.
-    P2DContact* c = m_contactList;
-	while (c)
+	// Age the warm starting cache once per time step.
+	m_impulseCache.Step();
+
+	// Update awake contacts. A destroyed contact is replaced by the last one,
+	// so the index only advances past contacts that persist.
+	int32 i = 0;
+	while (i < m_contactCount)
 	{
+        P2DContact* c = m_contacts[i];
         P2DFixture* fixtureA = c->GetFixtureA();
         P2DFixture* fixtureB = c->GetFixtureB();
         int32 indexA = c->GetChildIndexA();
@@ -103,18 +112,21 @@ void P2DContactManager::Collide()
 			// Should these bodies collide?
 			if (bodyB->ShouldCollide(bodyA) == false)
 			{
-				P2DContact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
+				continue;
+			}
+
+			// Check the proxy filters and the layer matrix.
+			if (m_broadPhase.ShouldPair(fixtureA->m_proxies[indexA].proxyId, fixtureB->m_proxies[indexB].proxyId) == false)
+			{
+				Destroy(c);
 				continue;
 			}
 
 			// Check user filtering.
 			if (m_contactFilter && m_contactFilter->ShouldCollide(fixtureA, fixtureB) == false)
 			{
-				P2DContact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
 				continue;
 			}
 
@@ -128,7 +140,7 @@ void P2DContactManager::Collide()
 		// At least one body must be awake and it must be dynamic or kinematic.
 		if (activeA == false && activeB == false)
 		{
-			c = c->GetNext();
+			++i;
 			continue;
 		}
 
@@ -139,15 +151,13 @@ void P2DContactManager::Collide()
 		// Here we destroy contacts that cease to overlap in the broad-phase.
 		if (overlap == false)
 		{
-			P2DContact* cNuke = c;
-			c = cNuke->GetNext();
-			Destroy(cNuke);
+			Destroy(c);
 			continue;
 		}
 
 		// The contact persists.
-		c->Update(m_contactListener);
-		c = c->GetNext();
+		c->Update(m_contactListener, &m_impulseCache);
+		++i;
 	}
 }
 
@@ -233,13 +243,16 @@ void P2DContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 	bodyB = fixtureB->GetBody();
 
 	// Insert into the world.
-	c->m_prev = NULL;
-	c->m_next = m_contactList;
-	if (m_contactList != NULL)
+	if (m_contactCount == m_contactCapacity)
 	{
-		m_contactList->m_prev = c;
+		P2DContact** oldContacts = m_contacts;
+		m_contactCapacity *= 2;
+		m_contacts = (P2DContact**)MemAlloc(m_contactCapacity * sizeof(P2DContact*), e_memObjects);
+		memcpy(m_contacts, oldContacts, m_contactCount * sizeof(P2DContact*));
+		MemFree(oldContacts);
 	}
-	m_contactList = c;
+	c->m_arrayIndex = m_contactCount;
+	m_contacts[m_contactCount] = c;
 
 	// Connect to island graph.
 
@@ -2,16 +2,18 @@
 #define P2D_CONTACT_MANAGER_H
 
 #include "../collision/p2dcoarsecollision.h"
+#include "../collision/p2dimpulsecache.h"
 
 class P2DContact;
 class P2DContactFilter;
 class P2DContactListener;
-class P2DBlockMem;
+class P2DPool;
 
 class P2DContactManager
 {
 public:
 	P2DContactManager();
+	~P2DContactManager();
 
 	// Broad-phase callback.
 	void AddPair(void* proxyUserDataA, void* proxyUserDataB);
@@ -24,11 +26,17 @@ public:
             
 	// TODO broad phase mod		
 	P2DCoarseCollision m_broadPhase;
-	P2DContact* m_contactList;
+
+	// The contacts are packed in an array. Destroy moves the last contact into
+	// the hole, so an index stays valid until a contact is destroyed.
+	P2DContact** m_contacts;
 	int32 m_contactCount;
+	int32 m_contactCapacity;
+
+	P2DImpulseCache m_impulseCache;
 	P2DContactFilter* m_contactFilter;
 	P2DContactListener* m_contactListener;
-	P2DBlockMem* m_allocator;
+	P2DPool* m_allocator;
 };
 
 #endif
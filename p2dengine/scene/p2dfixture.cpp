@@ -102,6 +102,18 @@ void P2DFixture::Destroy(P2DBlockMem* allocator)
 	m_shape = NULL;
 }
 
+static P2DProxyFilter P2DMakeProxyFilter(const P2DContactFilterData& data)
+{
+	assert(data.layer < P2D_MAX_LAYERS);
+
+	P2DProxyFilter filter;
+	filter.categoryBits = data.categoryBits;
+	filter.maskBits = data.maskBits;
+	filter.groupIndex = data.groupIndex;
+	filter.layerBits = (uint16)(1 << data.layer);
+	return filter;
+}
+
 void P2DFixture::CreateProxies(P2DCoarseCollision* coarseCollision, const P2DTransform& xf)
 {
 	assert(m_proxyCount == 0);
@@ -109,13 +121,15 @@ void P2DFixture::CreateProxies(P2DCoarseCollision* coarseCollision, const P2DTra
 	// Create proxies in the broad-phase.
 	m_proxyCount = m_shape->GetChildCount();
 
+	P2DProxyFilter filter = P2DMakeProxyFilter(m_filter);
 	for (int32 i = 0; i < m_proxyCount; ++i)
 	{
 		P2DFixtureProxy* proxy = m_proxies + i;
 		m_shape->ComputeAABB(&proxy->aabb, xf, i);
-        proxy->proxyId = coarseCollision->CreateProxy(proxy->aabb, proxy);
+        proxy->proxyId = coarseCollision->CreateProxy(proxy->aabb, proxy, filter);
 		proxy->fixture = this;
 		proxy->childIndex = i;
+		proxy->fixtureHandle = GetHandle();
 	}
 }
 
@@ -132,7 +146,7 @@ void P2DFixture::DestroyProxies(P2DCoarseCollision* coarseCollision)
 	m_proxyCount = 0;
 }
 
-void P2DFixture::Synchronize(P2DCoarseCollision* coarseCollision, const P2DTransform& transform1, const P2DTransform& transform2)
+void P2DFixture::Synchronize(P2DCoarseCollision* coarseCollision, const P2DTransform& transform1, const P2DTransform& transform2, bool teleport)
 {
 	if (m_proxyCount == 0)
 	{	
@@ -150,14 +164,19 @@ void P2DFixture::Synchronize(P2DCoarseCollision* coarseCollision, const P2DTrans
 	
 		proxy->aabb.Combine(aabb1, aabb2);
 
-        P2DVec2 displacement = transform2.position - transform1.position;
+		// Track the faces of the AABB rather than the origin, so turning shapes
+		// whose AABB grows and shrinks get a margin for it too.
+        P2DVec2 lowerMove = aabb2.lowerBound - aabb1.lowerBound;
+        P2DVec2 upperMove = aabb2.upperBound - aabb1.upperBound;
+        P2DVec2 displacement;
+		displacement.x = P2DAbs(lowerMove.x) > P2DAbs(upperMove.x) ? lowerMove.x : upperMove.x;
+		displacement.y = P2DAbs(lowerMove.y) > P2DAbs(upperMove.y) ? lowerMove.y : upperMove.y;
 
-        coarseCollision->MoveProxy(proxy->proxyId, proxy->aabb, displacement);
+        coarseCollision->MoveProxy(proxy->proxyId, proxy->aabb, displacement, teleport);
 	}
 }
 
-/*
-void P2DFixture::SetFilterData(const P2DFilter& filter)
+void P2DFixture::SetFilterData(const P2DContactFilterData& filter)
 {
 	m_filter = filter;
 
@@ -193,14 +212,15 @@ void P2DFixture::Refilter()
 		return;
 	}
 
-	// Touch each proxy so that new pairs may be created
-    P2DCoarseCollision* coarseCollision = &world->m_contactManager.m_coarseCollision;
+	// Update the proxy filters and touch each proxy so that new pairs may be created
+    P2DCoarseCollision* coarseCollision = &world->m_contactManager.m_broadPhase;
+	P2DProxyFilter proxyFilter = P2DMakeProxyFilter(m_filter);
 	for (int32 i = 0; i < m_proxyCount; ++i)
 	{
+        coarseCollision->SetProxyFilter(m_proxies[i].proxyId, proxyFilter);
         coarseCollision->TouchProxy(m_proxies[i].proxyId);
 	}
 }
-*/
 
 /*
 void P2DFixture::SetSensor(bool sensor)
@@ -225,6 +245,7 @@ void P2DFixture::Dump(int32 bodyIndex)
     P2DLog("    fd.filter.categoryBits = uint16(%d);\n", m_filter.categoryBits);
     P2DLog("    fd.filter.maskBits = uint16(%d);\n", m_filter.maskBits);
     P2DLog("    fd.filter.groupIndex = int16(%d);\n", m_filter.groupIndex);
+    P2DLog("    fd.filter.layer = uint8(%d);\n", m_filter.layer);
 	*/
 
 	switch (m_shape->m_type)
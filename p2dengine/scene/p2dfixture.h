@@ -18,6 +18,7 @@ struct P2DContactFilterData
 		categoryBits = 0x0001;
 		maskBits = 0xFFFF;
 		groupIndex = 0;
+		layer = 0;
 	}
 
 	/// The collision category bits. Normally you would just set one bit.
@@ -31,6 +32,10 @@ struct P2DContactFilterData
 	/// or always collide (positive). Zero means no collision group. Non-zero group
 	/// filtering always wins against the mask bits.
 	int16 groupIndex;
+
+	/// The collision layer in [0, P2D_MAX_LAYERS). Which layers collide is set
+	/// with P2DScene::SetLayerCollision. The layer matrix wins against the group.
+	uint8 layer;
 };
 
 /// A fixture definition is used to create a fixture. This class defines an
@@ -80,6 +85,7 @@ struct P2DFixtureProxy
 	P2DFixture* fixture;
 	int32 childIndex;
 	int32 proxyId;
+	P2DHandle fixtureHandle;	// saves buffered queries a trip to the fixture
 };
 
 /// A fixture is used to attach a shape to a body for collision detection. A fixture
@@ -137,6 +143,9 @@ public:
 	/// Set the user data. Use this to store your application specific data.
 	void SetUserData(void* data);
 
+	/// Get the handle of this fixture, see P2DScene::GetFixture.
+	P2DHandle GetHandle() const;
+
 	/// Test a point for containment in this fixture.
 	/// @param p a point in world coordinates.
 	bool TestPoint(const P2DVec2& p) const;
@@ -200,7 +209,7 @@ protected:
 	void CreateProxies(P2DCoarseCollision* broadPhase, const P2DTransform& xf);
 	void DestroyProxies(P2DCoarseCollision* broadPhase);
 
-	void Synchronize(P2DCoarseCollision* broadPhase, const P2DTransform& xf1, const P2DTransform& xf2);
+	void Synchronize(P2DCoarseCollision* broadPhase, const P2DTransform& xf1, const P2DTransform& xf2, bool teleport = false);
 
 	float32 m_density;
 
@@ -252,6 +261,11 @@ inline void* P2DFixture::GetUserData() const
 	return m_userData;
 }
 
+inline P2DHandle P2DFixture::GetHandle() const
+{
+	return P2DPool::GetHandle(this);
+}
+
 inline void P2DFixture::SetUserData(void* data)
 {
 	m_userData = data;
@@ -275,6 +275,173 @@ void P2DIsland::Solve(P2DProfile* profile, const P2DTimeStep& step, const P2DVec
 	}
 }
 
+void P2DIsland::SolveSoft(P2DProfile* profile, const P2DTimeStep& step, const P2DVec2& gravity, bool allowSleep, int32 subStepCount)
+{
+    assert(subStepCount > 0);
+
+    P2DTimer timer;
+
+	float32 h = step.dt / subStepCount;
+	float32 inv_h = subStepCount * step.inv_dt;
+
+	// Initialize the body state. Velocities are integrated per sub-step.
+	for (int32 i = 0; i < m_bodyCount; ++i)
+	{
+        P2DBody* b = m_bodies[i];
+
+		// Store positions for continuous collision.
+		b->m_sweep.c0 = b->m_sweep.c;
+		b->m_sweep.a0 = b->m_sweep.a;
+
+		m_positions[i].c = b->m_sweep.c;
+		m_positions[i].a = b->m_sweep.a;
+		m_velocities[i].v = b->m_linearVelocity;
+		m_velocities[i].w = b->m_angularVelocity;
+	}
+
+    P2DContactSolverDef contactSolverDef;
+	contactSolverDef.step = step;
+	contactSolverDef.contacts = m_contacts;
+	contactSolverDef.count = m_contactCount;
+	contactSolverDef.positions = m_positions;
+	contactSolverDef.velocities = m_velocities;
+	contactSolverDef.allocator = m_allocator;
+
+    P2DContactSolver contactSolver(&contactSolverDef);
+	contactSolver.InitializeSoftConstraints(h);
+
+	profile->solveInit = timer.GetMilliseconds();
+
+	timer.Reset();
+	for (int32 subStep = 0; subStep < subStepCount; ++subStep)
+	{
+		// Integrate velocities and apply damping.
+		for (int32 i = 0; i < m_bodyCount; ++i)
+		{
+            P2DBody* b = m_bodies[i];
+            if (b->m_type != P2D_DYNAMIC_BODY)
+			{
+				continue;
+			}
+
+            P2DVec2 v = m_velocities[i].v;
+			float32 w = m_velocities[i].w;
+
+			v += h * (b->m_gravityScale * gravity + b->m_invMass * b->m_force);
+			w += h * b->m_invI * b->m_torque;
+
+			v *= 1.0f / (1.0f + h * b->m_linearDamping);
+			w *= 1.0f / (1.0f + h * b->m_angularDamping);
+
+			m_velocities[i].v = v;
+			m_velocities[i].w = w;
+		}
+
+		// The accumulated impulses are re-applied every sub-step.
+		if (step.warmStarting)
+		{
+			contactSolver.WarmStart();
+		}
+
+		contactSolver.SolveSoftVelocityConstraints(inv_h, true);
+
+		// Integrate positions
+		for (int32 i = 0; i < m_bodyCount; ++i)
+		{
+            P2DVec2 v = m_velocities[i].v;
+			float32 w = m_velocities[i].w;
+
+			// Check for large velocities
+            P2DVec2 translation = h * v;
+            if (P2DVecDot(translation, translation) > P2D_MAX_TRANSLATION_SQUARED)
+			{
+                float32 ratio = P2D_MAX_TRANSLATION / translation.Length();
+				v *= ratio;
+			}
+
+			float32 rotation = h * w;
+            if (rotation * rotation > P2D_MAX_ROTATION_SQUARED)
+			{
+                float32 ratio = P2D_MAX_ROTATION / P2DAbs(rotation);
+				w *= ratio;
+			}
+
+			m_positions[i].c += h * v;
+			m_positions[i].a += h * w;
+			m_velocities[i].v = v;
+			m_velocities[i].w = w;
+		}
+
+		// Relax: remove the velocity added by the soft bias.
+		contactSolver.SolveSoftVelocityConstraints(inv_h, false);
+		contactSolver.AccumulateSoftImpulses();
+	}
+
+	contactSolver.ApplyRestitution();
+
+	// Store the impulses of the whole step, for warm starting, the impulse
+	// cache and the listener.
+	contactSolver.FinishSoftImpulses();
+	contactSolver.StoreImpulses();
+	profile->solveVelocity = timer.GetMilliseconds();
+
+	// There is no separate position pass.
+	profile->solvePosition = 0.0f;
+
+	// Copy state buffers back to the bodies
+	for (int32 i = 0; i < m_bodyCount; ++i)
+	{
+        P2DBody* body = m_bodies[i];
+		body->m_sweep.c = m_positions[i].c;
+		body->m_sweep.a = m_positions[i].a;
+		body->m_linearVelocity = m_velocities[i].v;
+		body->m_angularVelocity = m_velocities[i].w;
+		body->SynchronizeTransform();
+	}
+
+	Report(contactSolver.m_velocityConstraints);
+
+	if (allowSleep)
+	{
+        float32 minSleepTime = FLT_MAX;
+
+        const float32 linTolSqr = P2D_LINEAR_SLEEP_TOLERANCE * P2D_LINEAR_SLEEP_TOLERANCE;
+        const float32 angTolSqr = P2D_ANGULAR_SLEEP_TOLERANCE * P2D_ANGULAR_SLEEP_TOLERANCE;
+
+		for (int32 i = 0; i < m_bodyCount; ++i)
+		{
+            P2DBody* b = m_bodies[i];
+            if (b->GetType() == P2D_STATIC_BODY)
+			{
+				continue;
+			}
+
+            if ((b->m_flags & P2DBody::e_autoSleepFlag) == 0 ||
+				b->m_angularVelocity * b->m_angularVelocity > angTolSqr ||
+                P2DVecDot(b->m_linearVelocity, b->m_linearVelocity) > linTolSqr)
+			{
+				b->m_sleepTime = 0.0f;
+				minSleepTime = 0.0f;
+			}
+			else
+			{
+				b->m_sleepTime += step.dt;
+                minSleepTime = P2DMin(minSleepTime, b->m_sleepTime);
+			}
+		}
+
+		// Soft contacts keep pushing out overlap, so resting is enough to sleep.
+        if (minSleepTime >= P2D_TIME_TO_SLEEP)
+		{
+			for (int32 i = 0; i < m_bodyCount; ++i)
+			{
+                P2DBody* b = m_bodies[i];
+				b->SetAwake(false);
+			}
+		}
+	}
+}
+
 void P2DIsland::SolveTOI(const P2DTimeStep& subStep, int32 toiIndexA, int32 toiIndexB)
 {
     assert(toiIndexA < m_bodyCount);
@@ -29,6 +29,10 @@ public:
 
     void Solve(P2DProfile* profile, const P2DTimeStep& step, const P2DVec2& gravity, bool allowSleep);
 
+    /// Solve with subStepCount soft sub-steps and one relax iteration each instead of
+    /// velocity and position iterations. The iteration counts in step are ignored.
+    void SolveSoft(P2DProfile* profile, const P2DTimeStep& step, const P2DVec2& gravity, bool allowSleep, int32 subStepCount);
+
     void SolveTOI(const P2DTimeStep& subStep, int32 toiIndexA, int32 toiIndexB);
 
     void Add(P2DBody* body)
@@ -7,18 +7,24 @@
 #include "p2dcontactmanager.h"
 #include "../collision/p2dcontactsolver.h"
 #include "../collision/p2dcontact.h"
+#include "../collision/p2dpolygoncontact.h"
 #include "../collision/p2dcoarsecollision.h"
 //#include "CircleShape.h"
 //#include "EdgeShape.h"
 //#include "ChainShape.h"
 #include "../objects/p2dpolygonobject.h"
 #include "../collision/p2dtoi.h"
+#include "../collision/p2ddistance.h"
 //#include "Draw.h"
 #include "../general/p2dtimer.h"
 #include "../general/p2dcommonstructs.h"
 #include <new>
 
+// The contact pool slots must fit the largest contact type.
 P2DScene::P2DScene(const P2DVec2& gravity)
+	: m_bodyPool(sizeof(P2DBody), e_memObjects),
+	  m_fixturePool(sizeof(P2DFixture), e_memObjects),
+	  m_contactPool(sizeof(P2DPolygonContact), e_memObjects)
 {
 	m_destructionListener = NULL;
     //ying g_debugDraw = NULL;
@@ -31,10 +37,16 @@ P2DScene::P2DScene(const P2DVec2& gravity)
 
 	m_warmStarting = true;
 	m_continuousPhysics = true;
+	m_continuousMotionFraction = P2D_CCD_MOTION_FRACTION;
 	m_subStepping = false;
 
+	m_softStepping = false;
+	m_softSubStepCount = P2D_SOFT_SUB_STEPS;
+
 	m_stepComplete = true;
 
+	m_budgetLevel = 0;
+
 	m_allowSleep = true;
 	m_gravity = gravity;
 
@@ -42,7 +54,7 @@ P2DScene::P2DScene(const P2DVec2& gravity)
 
 	m_inv_dt0 = 0.0f;
 
-	m_contactManager.m_allocator = &m_blockAllocator;
+	m_contactManager.m_allocator = &m_contactPool;
 
     memset(&m_profile, 0, sizeof(P2DProfile));
 }
@@ -78,6 +90,39 @@ void P2DScene::SetContactFilter(P2DContactFilter* filter)
 	m_contactManager.m_contactFilter = filter;
 }
 
+void P2DScene::SetLayerCollision(int32 layerA, int32 layerB, bool flag)
+{
+	if (GetLayerCollision(layerA, layerB) == flag)
+	{
+		return;
+	}
+
+	P2DCoarseCollision* broadPhase = &m_contactManager.m_broadPhase;
+	broadPhase->SetLayerCollision(layerA, layerB, flag);
+
+	// Existing contacts are dropped at the next step, new pairs come from touching the proxies.
+	for (P2DContact* c = GetContactList(); c; c = c->GetNext())
+	{
+		c->FlagForFiltering();
+	}
+
+	for (P2DBody* b = m_bodyList; b; b = b->m_next)
+	{
+		for (P2DFixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int32 i = 0; i < f->m_proxyCount; ++i)
+			{
+				broadPhase->TouchProxy(f->m_proxies[i].proxyId);
+			}
+		}
+	}
+}
+
+bool P2DScene::GetLayerCollision(int32 layerA, int32 layerB) const
+{
+	return m_contactManager.m_broadPhase.GetLayerCollision(layerA, layerB);
+}
+
 void P2DScene::SetContactListener(P2DContactListener* listener)
 {
 	m_contactManager.m_contactListener = listener;
@@ -98,7 +143,7 @@ P2DBody* P2DScene::CreateBody(const P2DBodyDef* def)
 		return NULL;
 	}
 
-    void* mem = m_blockAllocator.Allocate(sizeof(P2DBody));
+    void* mem = m_bodyPool.Allocate(sizeof(P2DBody));
     P2DBody* b = new (mem) P2DBody(def, this);
 
 	// Add to world doubly linked list.
@@ -166,9 +211,10 @@ void P2DScene::DestroyBody(P2DBody* b)
 		}
 
 		f0->DestroyProxies(&m_contactManager.m_broadPhase);
+		m_contactManager.m_impulseCache.Purge(f0);
 		f0->Destroy(&m_blockAllocator);
         f0->~P2DFixture();
-        m_blockAllocator.Free(f0, sizeof(P2DFixture));
+        m_fixturePool.Free(f0);
 
 		b->m_fixtureList = f;
 		b->m_fixtureCount -= 1;
@@ -194,7 +240,7 @@ void P2DScene::DestroyBody(P2DBody* b)
 
 	--m_bodyCount;
     b->~P2DBody();
-    m_blockAllocator.Free(b, sizeof(P2DBody));
+    m_bodyPool.Free(b);
 }
 
 /*
@@ -376,25 +422,30 @@ void P2DScene::SetAllowSleeping(bool flag)
 // Find islands, integrate and solve constraints, solve position constraints
 void P2DScene::Solve(const P2DTimeStep& step)
 {
+	P2DStackMem* stackAllocator = GetStackAllocator(P2DGetWorkerIndex());
+
 	m_profile.solveInit = 0.0f;
 	m_profile.solveVelocity = 0.0f;
 	m_profile.solvePosition = 0.0f;
+	m_profile.syncCount = 0;
+	m_profile.syncSkipCount = 0;
 
 	// Size the island for the worst case.
     P2DIsland island(m_bodyCount,
 					m_contactManager.m_contactCount,
 					m_jointCount,
-					&m_stackAllocator,
+					stackAllocator,
 					m_contactManager.m_contactListener);
 
-	// Clear all the island flags.
-    for (P2DBody* b = m_bodyList; b; b = b->m_next)
-	{
-        b->m_flags &= ~P2DBody::e_islandFlag;
-	}
-    for (P2DContact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	// Clear all the island flags. Walk the pools rather than the lists,
+	// this touches the objects in memory order.
+	for (int32 i = 0; i < m_bodyPool.GetSlotCount(); ++i)
 	{
-        c->m_flags &= ~P2DContact::e_islandFlag;
+		P2DBody* b = (P2DBody*)m_bodyPool.GetSlot(i);
+		if (b)
+		{
+			b->m_flags &= ~P2DBody::e_islandFlag;
+		}
 	}
     /*
     for (P2DJoint* j = m_jointList; j; j = j->m_next)
@@ -403,12 +454,74 @@ void P2DScene::Solve(const P2DTimeStep& step)
 	}
     */
 
+	// Gather the contacts that can join islands (solid and touching) into one
+	// compact range per body, indexed by the body pool slot. The ranges hold
+	// contact array indices, which are stable until the next contact is destroyed.
+	// A counting sort: count, turn the counts into range ends, then fill backwards
+	// so the ends become starts.
+	int32 slotCount = m_bodyPool.GetSlotCount();
+	int32* ranges = (int32*)stackAllocator->Allocate((slotCount + 1) * sizeof(int32));
+	int32* adjacency = (int32*)stackAllocator->Allocate(2 * m_contactManager.m_contactCount * sizeof(int32));
+	memset(ranges, 0, (slotCount + 1) * sizeof(int32));
+
+	P2DContact** contacts = m_contactManager.m_contacts;
+	for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
+	{
+		P2DContact* c = contacts[i];
+		c->m_flags &= ~P2DContact::e_islandFlag;
+
+		if (c->IsEnabled() == false || c->IsTouching() == false ||
+			c->m_fixtureA->m_isSensor || c->m_fixtureB->m_isSensor)
+		{
+			continue;
+		}
+
+		// Islands don't propagate across static bodies, so they need no range.
+		P2DBody* bA = c->m_fixtureA->m_body;
+		P2DBody* bB = c->m_fixtureB->m_body;
+		if (bA->m_type != P2D_STATIC_BODY)
+		{
+			++ranges[P2DPool::GetIndex(bA->GetHandle())];
+		}
+		if (bB->m_type != P2D_STATIC_BODY)
+		{
+			++ranges[P2DPool::GetIndex(bB->GetHandle())];
+		}
+	}
+
+	for (int32 i = 1; i <= slotCount; ++i)
+	{
+		ranges[i] += ranges[i - 1];
+	}
+
+	for (int32 i = m_contactManager.m_contactCount - 1; i >= 0; --i)
+	{
+		P2DContact* c = contacts[i];
+		if (c->IsEnabled() == false || c->IsTouching() == false ||
+			c->m_fixtureA->m_isSensor || c->m_fixtureB->m_isSensor)
+		{
+			continue;
+		}
+
+		P2DBody* bA = c->m_fixtureA->m_body;
+		P2DBody* bB = c->m_fixtureB->m_body;
+		if (bA->m_type != P2D_STATIC_BODY)
+		{
+			adjacency[--ranges[P2DPool::GetIndex(bA->GetHandle())]] = i;
+		}
+		if (bB->m_type != P2D_STATIC_BODY)
+		{
+			adjacency[--ranges[P2DPool::GetIndex(bB->GetHandle())]] = i;
+		}
+	}
+
 	// Build and simulate all awake islands.
 	int32 stackSize = m_bodyCount;
-    P2DBody** stack = (P2DBody**)m_stackAllocator.Allocate(stackSize * sizeof(P2DBody*));
-    for (P2DBody* seed = m_bodyList; seed; seed = seed->m_next)
+    P2DBody** stack = (P2DBody**)stackAllocator->Allocate(stackSize * sizeof(P2DBody*));
+	for (int32 slot = 0; slot < slotCount; ++slot)
 	{
-        if (seed->m_flags & P2DBody::e_islandFlag)
+        P2DBody* seed = (P2DBody*)m_bodyPool.GetSlot(slot);
+        if (seed == NULL || (seed->m_flags & P2DBody::e_islandFlag))
 		{
 			continue;
 		}
@@ -448,10 +561,11 @@ void P2DScene::Solve(const P2DTimeStep& step)
 				continue;
 			}
 
-			// Search all contacts connected to this body.
-            for (P2DContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+			// Search all solid touching contacts connected to this body.
+			int32 slot = P2DPool::GetIndex(b->GetHandle());
+			for (int32 k = ranges[slot]; k < ranges[slot + 1]; ++k)
 			{
-                P2DContact* contact = ce->contact;
+                P2DContact* contact = contacts[adjacency[k]];
 
 				// Has this contact already been added to an island?
                 if (contact->m_flags & P2DContact::e_islandFlag)
@@ -459,25 +573,14 @@ void P2DScene::Solve(const P2DTimeStep& step)
 					continue;
 				}
 
-				// Is this contact solid and touching?
-				if (contact->IsEnabled() == false ||
-					contact->IsTouching() == false)
-				{
-					continue;
-				}
-
-				// Skip sensors.
-				bool sensorA = contact->m_fixtureA->m_isSensor;
-				bool sensorB = contact->m_fixtureB->m_isSensor;
-				if (sensorA || sensorB)
-				{
-					continue;
-				}
-
 				island.Add(contact);
                 contact->m_flags |= P2DContact::e_islandFlag;
 
-                P2DBody* other = ce->other;
+                P2DBody* other = contact->m_fixtureA->m_body;
+				if (other == b)
+				{
+					other = contact->m_fixtureB->m_body;
+				}
 
 				// Was the other body already added to this island?
                 if (other->m_flags & P2DBody::e_islandFlag)
@@ -523,7 +626,14 @@ void P2DScene::Solve(const P2DTimeStep& step)
 		}
 
         P2DProfile profile;
-		island.Solve(&profile, step, m_gravity, m_allowSleep);
+		if (m_softStepping)
+		{
+			island.SolveSoft(&profile, step, m_gravity, m_allowSleep && !step.skipSleep, step.softSubSteps);
+		}
+		else
+		{
+			island.Solve(&profile, step, m_gravity, m_allowSleep && !step.skipSleep);
+		}
 		m_profile.solveInit += profile.solveInit;
 		m_profile.solveVelocity += profile.solveVelocity;
 		m_profile.solvePosition += profile.solvePosition;
@@ -540,15 +650,18 @@ void P2DScene::Solve(const P2DTimeStep& step)
 		}
 	}
 
-	m_stackAllocator.Free(stack);
+	stackAllocator->Free(stack);
+	stackAllocator->Free(adjacency);
+	stackAllocator->Free(ranges);
 
 	{
         P2DTimer timer;
 		// Synchronize fixtures, check for out of range bodies.
-        for (P2DBody* b = m_bodyList; b; b = b->GetNext())
+		for (int32 i = 0; i < m_bodyPool.GetSlotCount(); ++i)
 		{
 			// If a body was not in an island then it did not move.
-            if ((b->m_flags & P2DBody::e_islandFlag) == 0)
+            P2DBody* b = (P2DBody*)m_bodyPool.GetSlot(i);
+            if (b == NULL || (b->m_flags & P2DBody::e_islandFlag) == 0)
 			{
 				continue;
 			}
@@ -558,12 +671,25 @@ void P2DScene::Solve(const P2DTimeStep& step)
 				continue;
 			}
 
+			// A body that is pinned or settled keeps its proxies. The proxies
+			// were synchronized to within a tolerance of the current pose.
+			if (b->IsSyncRequired() == false)
+			{
+				++m_profile.syncSkipCount;
+				continue;
+			}
+
 			// Update fixtures (for broad-phase).
 			b->SynchronizeFixtures();
+			++m_profile.syncCount;
 		}
 
 		// Look for new contacts.
 		m_contactManager.FindNewContacts();
+
+		// Solve runs once per step, unlike FindNewContacts, so the tree is
+		// rebalanced here and not after every TOI event.
+		m_contactManager.m_broadPhase.Rebalance();
         m_profile.coarseCollision = timer.GetMilliseconds();
 	}
 }
@@ -571,18 +697,40 @@ void P2DScene::Solve(const P2DTimeStep& step)
 // Find TOI contacts and solve them.
 void P2DScene::SolveTOI(const P2DTimeStep& step)
 {
-    P2DIsland island(2 * P2D_MAX_TOI_CONTACTS, P2D_MAX_TOI_CONTACTS, 0, &m_stackAllocator, m_contactManager.m_contactListener);
+    P2DIsland island(2 * P2D_MAX_TOI_CONTACTS, P2D_MAX_TOI_CONTACTS, 0,
+					 GetStackAllocator(P2DGetWorkerIndex()), m_contactManager.m_contactListener);
 
 	if (m_stepComplete)
 	{
-        for (P2DBody* b = m_bodyList; b; b = b->m_next)
+		for (int32 i = 0; i < m_bodyPool.GetSlotCount(); ++i)
 		{
-            b->m_flags &= ~P2DBody::e_islandFlag;
+            P2DBody* b = (P2DBody*)m_bodyPool.GetSlot(i);
+			if (b == NULL)
+			{
+				continue;
+			}
+
+            b->m_flags &= ~(P2DBody::e_islandFlag | P2DBody::e_fastFlag);
 			b->m_sweep.alpha0 = 0.0f;
+
+			// Flag bodies that moved far compared to their size this step.
+			// Only these and bullets can tunnel. A spinning body sweeps its
+			// far points through the rotation as well.
+			if (b->m_type != P2D_STATIC_BODY)
+			{
+				float32 travel = P2DDistance(b->m_sweep.c, b->m_sweep.c0) +
+					P2DAbs(b->m_sweep.a - b->m_sweep.a0) * b->m_maxExtent;
+				if (travel > m_continuousMotionFraction * b->m_minExtent)
+				{
+                    b->m_flags |= P2DBody::e_fastFlag;
+				}
+			}
 		}
 
-        for (P2DContact* c = m_contactManager.m_contactList; c; c = c->m_next)
+        for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
 		{
+            P2DContact* c = m_contactManager.m_contacts[i];
+
 			// Invalidate TOI
             c->m_flags &= ~(P2DContact::e_toiFlag | P2DContact::e_islandFlag);
 			c->m_toiCount = 0;
@@ -597,8 +745,10 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
         P2DContact* minContact = NULL;
 		float32 minAlpha = 1.0f;
 
-        for (P2DContact* c = m_contactManager.m_contactList; c; c = c->m_next)
+        for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
 		{
+            P2DContact* c = m_contactManager.m_contacts[i];
+
 			// Is this contact disabled?
 			if (c->IsEnabled() == false)
 			{
@@ -644,6 +794,14 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 					continue;
 				}
 
+				// Slow bodies cannot tunnel, skip the TOI unless one is fast or a bullet.
+                bool fastA = bA->IsBullet() || (bA->m_flags & P2DBody::e_fastFlag) != 0;
+                bool fastB = bB->IsBullet() || (bB->m_flags & P2DBody::e_fastFlag) != 0;
+				if (fastA == false && fastB == false)
+				{
+					continue;
+				}
+
                 bool collideA = bA->IsBullet() || typeA != P2D_DYNAMIC_BODY;
                 bool collideB = bB->IsBullet() || typeB != P2D_DYNAMIC_BODY;
 
@@ -653,6 +811,12 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 					continue;
 				}
 
+				// Over budget, only bullets are worth the TOI cost.
+				if (step.deferTOI && bA->IsBullet() == false && bB->IsBullet() == false)
+				{
+					continue;
+				}
+
 				// Compute the TOI for this contact.
 				// Put the sweeps onto the same time interval.
 				float32 alpha0 = bA->m_sweep.alpha0;
@@ -680,10 +844,22 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 				input.sweepA = bA->m_sweep;
 				input.sweepB = bB->m_sweep;
 				input.tMax = 1.0f;
+				input.cache = &c->m_toiCache;
 
                 P2DTOIOutput output;
                 P2DTimeOfImpact(&output, &input);
 
+				++m_profile.toiCount;
+				m_profile.toiIterations += output.iterations;
+				m_profile.toiRootIterations += output.rootIterations;
+
+				int32 bin = 0;
+				for (int32 n = output.rootIterations; n > 0 && bin < P2D_TOI_ROOT_HISTOGRAM_BINS - 1; n >>= 1)
+				{
+					++bin;
+				}
+				++m_profile.toiRootHistogram[bin];
+
 				// Beta is the fraction of the remaining portion of the .
 				float32 beta = output.t;
                 if (output.state == P2DTOIOutput::e_touching)
@@ -727,7 +903,7 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 		bB->Advance(minAlpha);
 
 		// The TOI contact likely has some new contact points.
-		minContact->Update(m_contactManager.m_contactListener);
+		minContact->Update(m_contactManager.m_contactListener, &m_contactManager.m_impulseCache);
         minContact->m_flags &= ~P2DContact::e_toiFlag;
 		++minContact->m_toiCount;
 
@@ -807,7 +983,7 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 					}
 
 					// Update the contact points
-					contact->Update(m_contactManager.m_contactListener);
+					contact->Update(m_contactManager.m_contactListener, &m_contactManager.m_impulseCache);
 
 					// Was the contact disabled by the user?
 					if (contact->IsEnabled() == false)
@@ -855,6 +1031,9 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 		subStep.positionIterations = 20;
 		subStep.velocityIterations = step.velocityIterations;
 		subStep.warmStarting = false;
+		subStep.softSubSteps = step.softSubSteps;
+		subStep.deferTOI = step.deferTOI;
+		subStep.skipSleep = step.skipSleep;
 		island.SolveTOI(subStep, bA->m_islandIndex, bB->m_islandIndex);
 
 		// Reset island flags and synchronize broad-phase proxies.
@@ -890,9 +1069,47 @@ void P2DScene::SolveTOI(const P2DTimeStep& step)
 }
 
 void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIterations)
+{
+	Step(dt, velocityIterations, positionIterations, 0.0f, NULL);
+}
+
+void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIterations,
+					float32 budget, P2DStepBudgetReport* report)
 {
     P2DTimer stepTimer;
 
+	// Pick the degrade level from how the previous step did.
+	if (budget > 0.0f)
+	{
+		if (m_profile.step > budget)
+		{
+			m_budgetLevel = P2DMin(m_budgetLevel + 1, 3);
+		}
+		else if (m_profile.step < 0.5f * budget)
+		{
+			m_budgetLevel = P2DMax(m_budgetLevel - 1, 0);
+		}
+	}
+	else
+	{
+		m_budgetLevel = 0;
+	}
+
+	int32 softSubSteps = m_softSubStepCount;
+	if (m_budgetLevel >= 3)
+	{
+		velocityIterations = P2DMin(velocityIterations, 1);
+		positionIterations = P2DMin(positionIterations, 1);
+		softSubSteps = 1;
+	}
+	else if (m_budgetLevel >= 1)
+	{
+		// Halve the work, but never ask for more than the caller did.
+		velocityIterations = velocityIterations > 0 ? P2DMax(velocityIterations / 2, 1) : 0;
+		positionIterations = positionIterations > 0 ? P2DMax(positionIterations / 2, 1) : 0;
+		softSubSteps = P2DMax(softSubSteps / 2, 1);
+	}
+
 	// If new fixtures were added, we need to find the new contacts.
 	if (m_flags & e_newFixture)
 	{
@@ -901,6 +1118,7 @@ void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIteratio
 	}
 
 	m_flags |= e_locked;
+	m_contactManager.m_broadPhase.ResetReinsertCount();
 
     P2DTimeStep step;
 	step.dt = dt;
@@ -917,7 +1135,10 @@ void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIteratio
 
 	step.dtRatio = m_inv_dt0 * dt;
 
+	step.softSubSteps = softSubSteps;
 	step.warmStarting = m_warmStarting;
+	step.deferTOI = m_budgetLevel >= 2;
+	step.skipSleep = m_budgetLevel >= 3;
 
 	// Update contacts. This is where some contacts are destroyed.
 	{
@@ -934,9 +1155,23 @@ void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIteratio
 		m_profile.solve = timer.GetMilliseconds();
 	}
 
+	m_profile.toiCount = 0;
+	m_profile.toiIterations = 0;
+	m_profile.toiRootIterations = 0;
+	for (int32 i = 0; i < P2D_TOI_ROOT_HISTOGRAM_BINS; ++i)
+	{
+		m_profile.toiRootHistogram[i] = 0;
+	}
+
 	// Handle TOI events.
 	if (m_continuousPhysics && step.dt > 0.0f)
 	{
+		// The budget is already spent, keep the TOI pass for bullets.
+		if (budget > 0.0f && stepTimer.GetMilliseconds() > budget)
+		{
+			step.deferTOI = true;
+		}
+
         P2DTimer timer;
 		SolveTOI(step);
 		m_profile.solveTOI = timer.GetMilliseconds();
@@ -954,15 +1189,32 @@ void P2DScene::Step(float32 dt, int32 velocityIterations, int32 positionIteratio
 
 	m_flags &= ~e_locked;
 
+	m_profile.reinsertCount = m_contactManager.m_broadPhase.GetReinsertCount();
 	m_profile.step = stepTimer.GetMilliseconds();
+
+	if (report)
+	{
+		report->budget = budget;
+		report->elapsed = m_profile.step;
+		report->degradeLevel = m_budgetLevel;
+		report->velocityIterations = step.velocityIterations;
+		report->positionIterations = step.positionIterations;
+		report->softSubSteps = step.softSubSteps;
+		report->deferredTOI = step.deferTOI && m_continuousPhysics;
+		report->skippedSleep = step.skipSleep;
+	}
 }
 
 void P2DScene::ClearForces()
 {
-    for (P2DBody* body = m_bodyList; body; body = body->GetNext())
+	for (int32 i = 0; i < m_bodyPool.GetSlotCount(); ++i)
 	{
-		body->m_force.SetZero();
-		body->m_torque = 0.0f;
+        P2DBody* body = (P2DBody*)m_bodyPool.GetSlot(i);
+		if (body)
+		{
+			body->m_force.SetZero();
+			body->m_torque = 0.0f;
+		}
 	}
 }
 
@@ -986,6 +1238,276 @@ void P2DScene::QueryAABB(P2DQueryCallback* callback, const P2DAABB& aabb) const
 	m_contactManager.m_broadPhase.Query(&wrapper, aabb);
 }
 
+// The second pass of a buffered AABB query. It runs over the candidates in
+// one plain scalar loop, the engine has no SIMD layer, and compacts the
+// survivors in place.
+struct P2DSceneAABBResolver
+{
+	// Resolves fixtures[first] to fixtures[count - 1] and returns the new count.
+	int32 Resolve(P2DHandle* fixtures, int32 first, int32 count)
+	{
+		P2DVec2 box[4];
+		box[0] = aabb.lowerBound;
+		box[1].Set(aabb.upperBound.x, aabb.lowerBound.y);
+		box[2] = aabb.upperBound;
+		box[3].Set(aabb.lowerBound.x, aabb.upperBound.y);
+
+		P2DDistanceInput input;
+		input.proxyB.m_vertices = box;
+		input.proxyB.m_count = 4;
+		input.proxyB.m_radius = 0.0f;
+		input.transformB.SetIdentity();
+		input.useRadii = true;
+
+		int32 written = first;
+		for (int32 i = first; i < count; ++i)
+		{
+			P2DFixtureProxy* proxy = (P2DFixtureProxy*)broadPhase->GetUserData((int32)fixtures[i]);
+			P2DFixture* fixture = proxy->fixture;
+
+			if (exact)
+			{
+				// The tight AABB settles most candidates without touching the shape.
+				// Only the ones straddling the box edge need the distance test.
+				if (P2DTestOverlap(proxy->aabb, aabb) == false)
+				{
+					continue;
+				}
+
+				if (aabb.Contains(proxy->aabb) == false)
+				{
+					input.proxyA.Set(fixture->GetShape(), proxy->childIndex);
+					input.transformA = fixture->GetBody()->GetTransform();
+
+					P2DSimplexCache cache;
+					cache.count = 0;
+					P2DDistanceOutput output;
+					P2DDistance(&output, &cache, &input);
+					if (output.distance >= 10.0f * FLT_EPSILON)
+					{
+						continue;
+					}
+				}
+			}
+
+			fixtures[written] = proxy->fixtureHandle;
+			++written;
+		}
+
+		return written;
+	}
+
+	const P2DCoarseCollision* broadPhase;
+	P2DAABB aabb;
+	bool exact;
+};
+
+// The second pass of a buffered point query.
+struct P2DScenePointResolver
+{
+	// Resolves fixtures[first] to fixtures[count - 1] and returns the new count.
+	int32 Resolve(P2DHandle* fixtures, int32 first, int32 count)
+	{
+		int32 written = first;
+		for (int32 i = first; i < count; ++i)
+		{
+			P2DFixtureProxy* proxy = (P2DFixtureProxy*)broadPhase->GetUserData((int32)fixtures[i]);
+			P2DFixture* fixture = proxy->fixture;
+
+			if (exact)
+			{
+				const P2DAABB& b = proxy->aabb;
+				if (point.x < b.lowerBound.x || point.y < b.lowerBound.y ||
+					point.x > b.upperBound.x || point.y > b.upperBound.y)
+				{
+					continue;
+				}
+
+				if (fixture->TestPoint(point) == false)
+				{
+					continue;
+				}
+			}
+
+			fixtures[written] = proxy->fixtureHandle;
+			++written;
+		}
+
+		return written;
+	}
+
+	const P2DCoarseCollision* broadPhase;
+	P2DVec2 point;
+	bool exact;
+};
+
+// Writes the proxy ids found by a broad-phase query to the fixture buffer. The
+// ids are replaced with fixture handles by the resolver. When the buffer fills
+// up with candidates of an exact query, they are resolved right away so the
+// rejected ones free their room, and the query only stops once the survivors
+// fill the buffer.
+template <typename T>
+struct P2DSceneQueryBuffer
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		if (count == capacity)
+		{
+			if (resolver->exact)
+			{
+				count = resolver->Resolve(fixtures, resolved, count);
+				resolved = count;
+			}
+
+			if (count == capacity)
+			{
+				truncated = true;
+				return false;
+			}
+		}
+
+		fixtures[count] = (P2DHandle)proxyId;
+		++count;
+		return true;
+	}
+
+	int32 Finish()
+	{
+		count = resolver->Resolve(fixtures, resolved, count);
+		resolved = count;
+		return count;
+	}
+
+	T* resolver;
+	P2DHandle* fixtures;
+	int32 count;
+	int32 resolved;
+	int32 capacity;
+	bool truncated;
+};
+
+int32 P2DScene::QueryAABB(const P2DAABB& aabb, P2DHandle* fixtures, int32 capacity,
+						  bool exact, bool* truncated) const
+{
+	if (truncated)
+	{
+		*truncated = false;
+	}
+
+	if (capacity <= 0)
+	{
+		return 0;
+	}
+
+	P2DSceneAABBResolver resolver;
+	resolver.broadPhase = &m_contactManager.m_broadPhase;
+	resolver.aabb = aabb;
+	resolver.exact = exact;
+
+	P2DSceneQueryBuffer<P2DSceneAABBResolver> buffer;
+	buffer.resolver = &resolver;
+	buffer.fixtures = fixtures;
+	buffer.count = 0;
+	buffer.resolved = 0;
+	buffer.capacity = capacity;
+	buffer.truncated = false;
+	resolver.broadPhase->Query(&buffer, aabb);
+
+	if (truncated)
+	{
+		*truncated = buffer.truncated;
+	}
+	return buffer.Finish();
+}
+
+int32 P2DScene::QueryPoint(const P2DVec2& point, P2DHandle* fixtures, int32 capacity,
+						   bool exact, bool* truncated) const
+{
+	if (truncated)
+	{
+		*truncated = false;
+	}
+
+	if (capacity <= 0)
+	{
+		return 0;
+	}
+
+	P2DScenePointResolver resolver;
+	resolver.broadPhase = &m_contactManager.m_broadPhase;
+	resolver.point = point;
+	resolver.exact = exact;
+
+	P2DAABB aabb;
+	aabb.lowerBound = point;
+	aabb.upperBound = point;
+
+	P2DSceneQueryBuffer<P2DScenePointResolver> buffer;
+	buffer.resolver = &resolver;
+	buffer.fixtures = fixtures;
+	buffer.count = 0;
+	buffer.resolved = 0;
+	buffer.capacity = capacity;
+	buffer.truncated = false;
+	resolver.broadPhase->Query(&buffer, aabb);
+
+	if (truncated)
+	{
+		*truncated = buffer.truncated;
+	}
+	return buffer.Finish();
+}
+
+int32 P2DScene::QueryAABBBatch(const P2DAABB* aabbs, int32 queryCount, P2DHandle* fixtures,
+							   int32* offsets, int32 capacity, bool exact, bool* truncated) const
+{
+	if (truncated)
+	{
+		*truncated = false;
+	}
+
+	int32 written = 0;
+	for (int32 i = 0; i < queryCount; ++i)
+	{
+		offsets[i] = written;
+
+		bool full;
+		written += QueryAABB(aabbs[i], fixtures + written, capacity - written, exact, &full);
+		if (truncated && (full || (written == capacity && i + 1 < queryCount)))
+		{
+			*truncated = true;
+		}
+	}
+
+	offsets[queryCount] = written;
+	return written;
+}
+
+int32 P2DScene::QueryPointBatch(const P2DVec2* points, int32 queryCount, P2DHandle* fixtures,
+								int32* offsets, int32 capacity, bool exact, bool* truncated) const
+{
+	if (truncated)
+	{
+		*truncated = false;
+	}
+
+	int32 written = 0;
+	for (int32 i = 0; i < queryCount; ++i)
+	{
+		offsets[i] = written;
+
+		bool full;
+		written += QueryPoint(points[i], fixtures + written, capacity - written, exact, &full);
+		if (truncated && (full || (written == capacity && i + 1 < queryCount)))
+		{
+			*truncated = true;
+		}
+	}
+
+	offsets[queryCount] = written;
+	return written;
+}
+
 struct P2DSceneRayCastWrapper
 {
     float32 RayCastCallback(const P2DRayCastInput& input, int32 proxyId)
@@ -1023,6 +1545,214 @@ void P2DScene::RayCast(P2DRayCastCallback* callback, const P2DVec2& point1, cons
 	m_contactManager.m_broadPhase.RayCast(&wrapper, input);
 }
 
+struct P2DSceneRayCastBatchWrapper
+{
+	float32 RayCastCallback(int32 rayIndex, const P2DRayCastInput& input, int32 proxyId)
+	{
+		P2DFixtureProxy* proxy = (P2DFixtureProxy*)coarseCollision->GetUserData(proxyId);
+		P2DFixture* fixture = proxy->fixture;
+		P2DRayCastOutput output;
+		bool hit = fixture->RayCast(&output, input, proxy->childIndex);
+
+		if (hit == false)
+		{
+			return -1.0f;
+		}
+
+		// Keep the closest hit by clipping the ray to it.
+		P2DRayCastHit* result = hits + rayIndex;
+		result->fixture = fixture;
+		result->fraction = output.fraction;
+		result->point = (1.0f - output.fraction) * input.p1 + output.fraction * input.p2;
+		result->normal = output.normal;
+		return output.fraction;
+	}
+
+	const P2DCoarseCollision* coarseCollision;
+	P2DRayCastHit* hits;
+};
+
+void P2DScene::RayCastBatch(const P2DRayCastInput* inputs, P2DRayCastHit* hits, int32 count) const
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		hits[i].fixture = NULL;
+		hits[i].point = inputs[i].p1 + inputs[i].maxFraction * (inputs[i].p2 - inputs[i].p1);
+		hits[i].normal.SetZero();
+		hits[i].fraction = inputs[i].maxFraction;
+	}
+
+	P2DSceneRayCastBatchWrapper wrapper;
+	wrapper.coarseCollision = &m_contactManager.m_broadPhase;
+
+	for (int32 base = 0; base < count; base += P2D_RAY_PACKET_SIZE)
+	{
+		wrapper.hits = hits + base;
+		int32 packetCount = P2DMin(count - base, P2D_RAY_PACKET_SIZE);
+		m_contactManager.m_broadPhase.RayCastPacket(&wrapper, inputs + base, packetCount);
+	}
+}
+
+struct P2DSceneShapeCastWrapper
+{
+	float32 ShapeCastCallback(int32 proxyId, float32 maxFraction)
+	{
+		P2DFixtureProxy* proxy = (P2DFixtureProxy*)coarseCollision->GetUserData(proxyId);
+		P2DFixture* fixture = proxy->fixture;
+
+		input.proxyA.Set(fixture->GetShape(), proxy->childIndex);
+		input.transformA = fixture->GetBody()->GetTransform();
+
+		P2DShapeCastOutput output;
+		if (P2DShapeCast(&output, &input) == false || output.lambda > maxFraction)
+		{
+			return -1.0f;
+		}
+
+		hit->fixture = fixture;
+		hit->point = output.point;
+		hit->normal = output.normal;
+		hit->fraction = output.lambda;
+
+		// Clip the path to the hit, or stop at it if any hit will do.
+		return anyHit ? 0.0f : output.lambda;
+	}
+
+	const P2DCoarseCollision* coarseCollision;
+	P2DShapeCastInput input;
+	P2DRayCastHit* hit;
+	bool anyHit;
+};
+
+// Sweep one shape, the wrapper holds the cast shape already.
+static bool P2DShapeCastOne(const P2DCoarseCollision* broadPhase, P2DSceneShapeCastWrapper* wrapper,
+							const P2DBaseObject* shape, const P2DTransform& transform,
+							const P2DVec2& translation, P2DRayCastHit* hit)
+{
+	hit->fixture = NULL;
+	hit->point = transform.position + translation;
+	hit->normal.SetZero();
+	hit->fraction = 1.0f;
+
+	wrapper->input.transformB = transform;
+	wrapper->input.translationB = translation;
+	wrapper->hit = hit;
+
+	P2DAABB aabb;
+	shape->ComputeAABB(&aabb, transform, 0);
+	broadPhase->ShapeCast(wrapper, aabb, translation, 1.0f);
+
+	return hit->fixture != NULL;
+}
+
+bool P2DScene::ShapeCast(const P2DBaseObject* shape, const P2DTransform& transform,
+						 const P2DVec2& translation, P2DRayCastHit* hit) const
+{
+	assert(shape->GetChildCount() == 1);
+
+	P2DSceneShapeCastWrapper wrapper;
+	wrapper.coarseCollision = &m_contactManager.m_broadPhase;
+	wrapper.input.proxyB.Set(shape, 0);
+	wrapper.anyHit = false;
+	return P2DShapeCastOne(wrapper.coarseCollision, &wrapper, shape, transform, translation, hit);
+}
+
+bool P2DScene::ShapeCastAny(const P2DBaseObject* shape, const P2DTransform& transform,
+							const P2DVec2& translation, P2DRayCastHit* hit) const
+{
+	assert(shape->GetChildCount() == 1);
+
+	P2DSceneShapeCastWrapper wrapper;
+	wrapper.coarseCollision = &m_contactManager.m_broadPhase;
+	wrapper.input.proxyB.Set(shape, 0);
+	wrapper.anyHit = true;
+	return P2DShapeCastOne(wrapper.coarseCollision, &wrapper, shape, transform, translation, hit);
+}
+
+void P2DScene::ShapeCastBatch(const P2DBaseObject* shape, const P2DTransform* transforms,
+							  const P2DVec2* translations, P2DRayCastHit* hits, int32 count,
+							  bool anyHit) const
+{
+	assert(shape->GetChildCount() == 1);
+
+	P2DSceneShapeCastWrapper wrapper;
+	wrapper.coarseCollision = &m_contactManager.m_broadPhase;
+	wrapper.input.proxyB.Set(shape, 0);
+	wrapper.anyHit = anyHit;
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		P2DShapeCastOne(wrapper.coarseCollision, &wrapper, shape, transforms[i], translations[i], hits + i);
+	}
+}
+
+struct P2DSceneNearestWrapper
+{
+	float32 NearestCallback(int32 proxyId, const P2DVec2& point, float32 maxDistance)
+	{
+		NOT_USED(maxDistance);
+		P2DFixtureProxy* proxy = (P2DFixtureProxy*)coarseCollision->GetUserData(proxyId);
+		P2DFixture* fixture = proxy->fixture;
+
+		input.proxyA.Set(fixture->GetShape(), proxy->childIndex);
+		input.transformA = fixture->GetBody()->GetTransform();
+		input.proxyB.m_vertices = &point;
+
+		P2DSimplexCache cache;
+		cache.count = 0;
+		P2DDistance(&output, &cache, &input);
+		return output.distance;
+	}
+
+	const P2DCoarseCollision* coarseCollision;
+	P2DDistanceInput input;
+	P2DDistanceOutput output;
+};
+
+int32 P2DScene::QueryNearest(const P2DVec2& point, float32 maxDistance, P2DNearestHit* hits, int32 k) const
+{
+	if (k <= 0)
+	{
+		return 0;
+	}
+
+	const int32 stackSize = 32;
+	P2DProxyDistance stackResults[stackSize];
+	P2DProxyDistance* results = stackResults;
+	if (k > stackSize)
+	{
+		results = (P2DProxyDistance*)MemAlloc(k * sizeof(P2DProxyDistance));
+	}
+
+	P2DSceneNearestWrapper wrapper;
+	wrapper.coarseCollision = &m_contactManager.m_broadPhase;
+	wrapper.input.proxyB.m_count = 1;
+	wrapper.input.proxyB.m_radius = 0.0f;
+	wrapper.input.transformB.SetIdentity();
+	wrapper.input.useRadii = true;
+
+	int32 count = m_contactManager.m_broadPhase.QueryNearest(&wrapper, point, maxDistance, results, k);
+
+	// Only the winners need their closest point, so it is computed again here
+	// instead of being kept for every candidate.
+	for (int32 i = 0; i < count; ++i)
+	{
+		wrapper.NearestCallback(results[i].proxyId, point, maxDistance);
+
+		P2DFixtureProxy* proxy = (P2DFixtureProxy*)m_contactManager.m_broadPhase.GetUserData(results[i].proxyId);
+		hits[i].fixture = proxy->fixture;
+		hits[i].point = results[i].distance > 0.0f ? wrapper.output.pointA : point;
+		hits[i].distance = results[i].distance;
+	}
+
+	if (results != stackResults)
+	{
+		MemFree(results);
+	}
+
+	return count;
+}
+
 /*
 void P2DScene::DrawShape(P2DFixture* fixture, const P2DTransform& xf, const P2DColor& color)
 {
@@ -1186,7 +1916,7 @@ void P2DScene::DrawDebugData()
     if (flags & P2DDraw::e_pairBit)
 	{
         P2DColor color(0.3f, 0.9f, 0.9f);
-        for (P2DContact* c = m_contactManager.m_contactList; c; c = c->GetNext())
+        for (P2DContact* c = GetContactList(); c; c = c->GetNext())
 		{
             //P2DFixture* fixtureA = c->GetFixtureA();
             //P2DFixture* fixtureB = c->GetFixtureB();
@@ -1240,6 +1970,58 @@ void P2DScene::DrawDebugData()
 }
 */
 
+P2DStackMem* P2DScene::GetStackAllocator(int32 worker)
+{
+    assert(worker == P2D_NO_WORKER || (0 <= worker && worker < P2D_MAX_WORKERS));
+	return m_stackAllocators + (worker == P2D_NO_WORKER ? P2D_MAX_WORKERS : worker);
+}
+
+P2DStackStats P2DScene::GetStackStats() const
+{
+    P2DStackStats stats;
+	memset(&stats, 0, sizeof(stats));
+	for (int32 i = 0; i <= P2D_MAX_WORKERS; ++i)
+	{
+        P2DStackStats s = m_stackAllocators[i].GetStats();
+        stats.maxAllocation = P2DMax(stats.maxAllocation, s.maxAllocation);
+		stats.reserved += s.reserved;
+		stats.fallbackCount += s.fallbackCount;
+        stats.maxEntryCount = P2DMax(stats.maxEntryCount, s.maxEntryCount);
+	}
+	return stats;
+}
+
+P2DBody* P2DScene::GetBody(P2DHandle handle)
+{
+	return (P2DBody*)m_bodyPool.Get(handle);
+}
+
+P2DFixture* P2DScene::GetFixture(P2DHandle handle)
+{
+	return (P2DFixture*)m_fixturePool.Get(handle);
+}
+
+P2DContact* P2DScene::GetContact(P2DHandle handle)
+{
+	return (P2DContact*)m_contactPool.Get(handle);
+}
+
+int32 P2DScene::TrimMemory()
+{
+	assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return 0;
+	}
+
+	return m_blockAllocator.Trim();
+}
+
+P2DBlockStats P2DScene::GetBlockStats(int32 sizeClass) const
+{
+	return m_blockAllocator.GetStats(sizeClass);
+}
+
 int32 P2DScene::GetProxyCount() const
 {
 	return m_contactManager.m_broadPhase.GetProxyCount();
@@ -1260,6 +2042,16 @@ float32 P2DScene::GetTreeQuality() const
 	return m_contactManager.m_broadPhase.GetTreeQuality();
 }
 
+void P2DScene::SetTreeRebalanceBudget(int32 leafCount)
+{
+	m_contactManager.m_broadPhase.SetRebalanceBudget(leafCount);
+}
+
+int32 P2DScene::GetTreeRebalanceBudget() const
+{
+	return m_contactManager.m_broadPhase.GetRebalanceBudget();
+}
+
 void P2DScene::ShiftOrigin(const P2DVec2& newOrigin)
 {
     assert((m_flags & e_locked) == 0);
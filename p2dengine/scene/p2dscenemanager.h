@@ -3,6 +3,7 @@
 
 #include "../general/p2dmath.h"
 #include "../general/p2dmem.h"
+#include "../general/p2dpool.h"
 #include "p2dcontactmanager.h"
 #include "p2dscenecallback.h"
 #include "../general/p2dcommonstructs.h"
@@ -17,6 +18,24 @@ class P2DBody;
 class P2DFixture;
 //class P2DJoint;
 
+/// The closest hit of a ray or of a swept shape, see P2DScene::RayCastBatch
+/// and P2DScene::ShapeCast.
+struct P2DRayCastHit
+{
+	P2DFixture* fixture;	///< the fixture hit, NULL if the ray hit nothing
+	P2DVec2 point;			///< the point of initial intersection
+	P2DVec2 normal;			///< the normal vector at the point of intersection
+	float32 fraction;		///< the hit fraction along the ray, maxFraction on a miss
+};
+
+/// A fixture found by P2DScene::QueryNearest.
+struct P2DNearestHit
+{
+	P2DFixture* fixture;	///< the fixture
+	P2DVec2 point;			///< the closest point on the fixture, the query point if the fixture contains it
+	float32 distance;		///< the distance to the query point, zero if the fixture contains it
+};
+
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
 /// management facilities.
@@ -39,6 +58,14 @@ public:
 	/// owned by you and must remain in scope. 
 	void SetContactFilter(P2DContactFilter* filter);
 
+	/// Enable or disable collision between two fixture layers, see
+	/// P2DContactFilterData::layer. All layers collide by default. Pairs of
+	/// layers that don't collide are rejected in the broad-phase.
+	void SetLayerCollision(int32 layerA, int32 layerB, bool flag);
+
+	/// Do two fixture layers collide?
+	bool GetLayerCollision(int32 layerA, int32 layerB) const;
+
 	/// Register a contact event listener. The listener is owned by you and must
 	/// remain in scope.
 	void SetContactListener(P2DContactListener* listener);
@@ -77,6 +104,20 @@ public:
 				int32 velocityIterations,
 				int32 positionIterations);
 
+	/// Take a time step within a wall clock budget. When the previous steps ran
+	/// over budget the step degrades gracefully, one level at a time: first the
+	/// iteration counts are halved, then continuous collision is deferred for
+	/// non-bullet bodies, then sleep checks are skipped and a single iteration is
+	/// used. Levels are restored once steps fit in half the budget again. TOI is
+	/// also deferred on the spot if the budget is already used up by the solver.
+	/// @param budget the wall clock budget in milliseconds, non-positive for none.
+	/// @param report receives what was degraded, may be NULL.
+	void Step(	float32 timeStep,
+				int32 velocityIterations,
+				int32 positionIterations,
+				float32 budget,
+				P2DStepBudgetReport* report);
+
 	/// Manually clear the force buffer on all bodies. By default, forces are cleared automatically
 	/// after each call to Step. The default behavior is modified by calling SetAutoClearForces.
 	/// The purpose of this function is to support sub-stepping. Sub-stepping is often used to maintain
@@ -95,6 +136,42 @@ public:
 	/// @param aabb the query box.
 	void QueryAABB(P2DQueryCallback* callback, const P2DAABB& aabb) const;
 
+	/// Query the world for all fixtures that overlap the provided AABB and write
+	/// their handles to a buffer. The broad-phase pass collects the candidates
+	/// first, a second pass over them applies the exact shape test. Candidates
+	/// rejected by it don't take up room in the buffer.
+	/// A fixture with several children may be reported once per child.
+	/// @param aabb the query box.
+	/// @param fixtures receives the fixture handles.
+	/// @param capacity the size of the buffer. The query stops when it is full.
+	/// @param exact only report fixtures whose shape overlaps the box, without it
+	/// this reports the fixtures whose fat AABB overlaps the box.
+	/// @param truncated if not NULL, set when the buffer was too small and
+	/// fixtures may be missing. Query again with a larger buffer then.
+	/// @return the number of handles written.
+	int32 QueryAABB(const P2DAABB& aabb, P2DHandle* fixtures, int32 capacity,
+					bool exact = true, bool* truncated = NULL) const;
+
+	/// Query the world for the fixtures that contain a point, see QueryAABB.
+	/// The exact pass uses P2DFixture::TestPoint, without it this reports the
+	/// fixtures whose fat AABB contains the point.
+	/// @return the number of handles written.
+	int32 QueryPoint(const P2DVec2& point, P2DHandle* fixtures, int32 capacity,
+					 bool exact = true, bool* truncated = NULL) const;
+
+	/// Run many AABB queries at once. The results of query i are
+	/// fixtures[offsets[i]] to fixtures[offsets[i + 1] - 1].
+	/// @param offsets receives queryCount + 1 offsets into fixtures.
+	/// @param truncated if not NULL, set when the buffer was too small for all
+	/// the results. Once the buffer is full the remaining queries report nothing.
+	/// @return the number of handles written.
+	int32 QueryAABBBatch(const P2DAABB* aabbs, int32 queryCount, P2DHandle* fixtures,
+						 int32* offsets, int32 capacity, bool exact = true, bool* truncated = NULL) const;
+
+	/// Run many point queries at once, see QueryAABBBatch.
+	int32 QueryPointBatch(const P2DVec2* points, int32 queryCount, P2DHandle* fixtures,
+						  int32* offsets, int32 capacity, bool exact = true, bool* truncated = NULL) const;
+
 	/// Ray-cast the world for all fixtures in the path of the ray. Your callback
 	/// controls whether you get the closest point, any point, or n-points.
 	/// The ray-cast ignores shapes that contain the starting point.
@@ -103,6 +180,54 @@ public:
 	/// @param point2 the ray ending point
 	void RayCast(P2DRayCastCallback* callback, const P2DVec2& point1, const P2DVec2& point2) const;
 
+	/// Ray-cast the world for the closest hit of many rays at once. The rays are
+	/// grouped into packets of P2D_RAY_PACKET_SIZE consecutive rays that traverse
+	/// the broad-phase together, so order coherent rays next to each other.
+	/// Like RayCast this ignores shapes that contain the starting point.
+	/// This only reads the world. Several threads may cast disjoint ranges of
+	/// rays at the same time, as long as nothing modifies the world meanwhile.
+	/// @param inputs the rays. A ray extends from p1 to p1 + maxFraction * (p2 - p1).
+	/// @param hits receives the closest hit of each ray.
+	/// @param count the number of rays.
+	void RayCastBatch(const P2DRayCastInput* inputs, P2DRayCastHit* hits, int32 count) const;
+
+	/// Sweep a shape along a translation and find the first fixture it touches.
+	/// The tree is searched along the path of the shape's AABB and each
+	/// candidate is tested with P2DShapeCast. A fixture the shape touches at
+	/// the start is a hit at fraction zero with a zero normal.
+	/// @param shape the shape to cast. It must have a single child.
+	/// @param transform the start transform of the shape.
+	/// @param translation the path of the shape. A zero translation tests for overlap.
+	/// @param hit receives the earliest hit, with the fraction of the translation
+	/// travelled and the point and normal on the fixture hit.
+	/// @return true if the shape touches a fixture along the path.
+	bool ShapeCast(const P2DBaseObject* shape, const P2DTransform& transform,
+				   const P2DVec2& translation, P2DRayCastHit* hit) const;
+
+	/// Sweep a shape like ShapeCast but stop at the first fixture found, which
+	/// need not be the earliest. This is enough to tell if a path is blocked,
+	/// e.g. for placement previews.
+	bool ShapeCastAny(const P2DBaseObject* shape, const P2DTransform& transform,
+					  const P2DVec2& translation, P2DRayCastHit* hit) const;
+
+	/// Sweep a shape from many start transforms. A miss reports a NULL fixture
+	/// and a fraction of one.
+	/// @param anyHit stop each cast at the first fixture found, see ShapeCastAny.
+	void ShapeCastBatch(const P2DBaseObject* shape, const P2DTransform* transforms,
+						const P2DVec2* translations, P2DRayCastHit* hits, int32 count,
+						bool anyHit = false) const;
+
+	/// Find the fixtures closest to a point. The broad-phase tree is searched
+	/// with branch and bound and the exact distance to each candidate is
+	/// computed with P2DDistance. Use k = 1 to find the closest fixture.
+	/// A fixture with several children may be reported once per child.
+	/// @param point the query point.
+	/// @param maxDistance only report fixtures within this distance. Use FLT_MAX for no limit.
+	/// @param hits receives up to k fixtures, sorted by increasing distance.
+	/// @param k the size of the hits array.
+	/// @return the number of fixtures found.
+	int32 QueryNearest(const P2DVec2& point, float32 maxDistance, P2DNearestHit* hits, int32 k) const;
+
 	/// Get the world body list. With the returned body, use P2DBody::GetNext to get
 	/// the next body in the world list. A NULL body indicates the end of the list.
 	/// @return the head of the world body list.
@@ -117,7 +242,7 @@ public:
 
 	/// Get the world contact list. With the returned contact, use P2DContact::GetNext to get
 	/// the next contact in the world list. A NULL contact indicates the end of the list.
-	/// @return the head of the world contact list.
+	/// @return the first contact of the world contact array.
 	/// @warning contacts are created and destroyed in the middle of a time step.
 	/// Use P2DContactListener to avoid missing contacts.
 	P2DContact* GetContactList();
@@ -135,10 +260,26 @@ public:
 	void SetContinuousPhysics(bool flag) { m_continuousPhysics = flag; }
 	bool GetContinuousPhysics() const { return m_continuousPhysics; }
 
+	/// Set the fraction of its smallest extent a body has to move in a step
+	/// before it gets continuous collision. Bullets always get it. Use zero to
+	/// treat every moving body as fast.
+	void SetContinuousMotionFraction(float32 fraction) { m_continuousMotionFraction = fraction; }
+	float32 GetContinuousMotionFraction() const { return m_continuousMotionFraction; }
+
 	/// Enable/disable single stepped continuous physics. For testing.
 	void SetSubStepping(bool flag) { m_subStepping = flag; }
 	bool GetSubStepping() const { return m_subStepping; }
 
+	/// Enable/disable the soft step solver. Instead of velocity and position
+	/// iterations each step is split into sub-steps with soft contacts and one
+	/// relax iteration each. The iteration counts given to Step are then ignored.
+	void SetSoftStepping(bool flag) { m_softStepping = flag; }
+	bool GetSoftStepping() const { return m_softStepping; }
+
+	/// Set the number of sub-steps used by the soft step solver.
+	void SetSoftSubStepCount(int32 count) { assert(count > 0); m_softSubStepCount = count; }
+	int32 GetSoftSubStepCount() const { return m_softSubStepCount; }
+
 	/// Get the number of broad-phase proxies.
 	int32 GetProxyCount() const;
 
@@ -161,6 +302,12 @@ public:
 	/// The minimum is 1.
 	float32 GetTreeQuality() const;
 
+	/// Set the number of dynamic tree leaves re-inserted per time step to keep
+	/// the tree quality from degrading as bodies move. Zero disables it.
+	/// The default is P2D_TREE_REBALANCE_BUDGET.
+	void SetTreeRebalanceBudget(int32 leafCount);
+	int32 GetTreeRebalanceBudget() const;
+
 	/// Change the global gravity vector.
 	void SetGravity(const P2DVec2& gravity);
 	
@@ -187,6 +334,39 @@ public:
 	/// Get the current profile.
 	const P2DProfile& GetProfile() const;
 
+	/// Get a body from its handle.
+	/// @return NULL if the body was destroyed.
+	P2DBody* GetBody(P2DHandle handle);
+
+	/// Get a fixture from its handle.
+	/// @return NULL if the fixture was destroyed.
+	P2DFixture* GetFixture(P2DHandle handle);
+
+	/// Get a contact from its handle.
+	/// @return NULL if the contact was destroyed.
+	P2DContact* GetContact(P2DHandle handle);
+
+	/// Get the per step stack allocator of a worker thread, by its
+	/// P2DGetWorkerIndex. Step uses the one of the thread that calls it.
+	/// Each thread must only use its own allocator. The one of P2D_NO_WORKER
+	/// is shared by all threads without an index, only one of them may use
+	/// it at a time.
+	P2DStackMem* GetStackAllocator(int32 worker);
+
+	/// Get the stack allocator telemetry. The peaks are the largest of any
+	/// worker, the reserved bytes and fallback counts are summed.
+	P2DStackStats GetStackStats() const;
+
+	/// Release the small object memory that is no longer in use, e.g. after
+	/// destroying a large part of the scene.
+	/// @warning this should be called outside of a time step.
+	/// @return the number of bytes released.
+	int32 TrimMemory();
+
+	/// Get the small object allocator telemetry of a size class.
+	/// @param sizeClass in [0, BLOCK_SIZES)
+	P2DBlockStats GetBlockStats(int32 sizeClass) const;
+
 	/// Dump the world into the log file.
 	/// @warning this should be called outside of a time step.
 	void Dump();
@@ -204,6 +384,7 @@ private:
 	friend class P2DBody;
 	friend class P2DFixture;
 	friend class P2DContactManager;
+	friend class P2DContact;
     //friend class P2DController;
 
 	void Solve(const P2DTimeStep& step);
@@ -213,7 +394,11 @@ private:
 	//void DrawShape(P2DFixture* shape, const P2DTransform& xf, const P2DColor& color);
 
 	P2DBlockMem m_blockAllocator;
-	P2DStackMem m_stackAllocator;
+	P2DStackMem m_stackAllocators[P2D_MAX_WORKERS + 1];	// the last one for P2D_NO_WORKER
+
+	P2DPool m_bodyPool;
+	P2DPool m_fixturePool;
+	P2DPool m_contactPool;
 
 	int32 m_flags;
 
@@ -239,9 +424,16 @@ private:
 	bool m_warmStarting;
 	bool m_continuousPhysics;
 	bool m_subStepping;
+	float32 m_continuousMotionFraction;
+
+	bool m_softStepping;
+	int32 m_softSubStepCount;
 
 	bool m_stepComplete;
 
+	// Degrade level of budgeted steps, see Step.
+	int32 m_budgetLevel;
+
 	P2DProfile m_profile;
 };
 
@@ -269,12 +461,12 @@ inline const P2DJoint* P2DScene::GetJointList() const
 
 inline P2DContact* P2DScene::GetContactList()
 {
-	return m_contactManager.m_contactList;
+	return m_contactManager.m_contactCount > 0 ? m_contactManager.m_contacts[0] : NULL;
 }
 
 inline const P2DContact* P2DScene::GetContactList() const
 {
-	return m_contactManager.m_contactList;
+	return m_contactManager.m_contactCount > 0 ? m_contactManager.m_contacts[0] : NULL;
 }
 
 inline int32 P2DScene::GetBodyCount() const
@@ -0,0 +1,225 @@
+#include "physicsthread.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include "p2dengine/scene/p2dbody.h"
+#include "p2dengine/general/p2dthread.h"
+
+// Marks the spare buffer as newer than the front one.
+static const int FRESH_SNAPSHOT = 4;
+static const int SNAPSHOT_INDEX_MASK = 3;
+
+// The most steps taken to catch up with the clock at once.
+static const int MAX_STEPS_PER_WAKE = 4;
+
+
+const BodyPose* PoseSnapshot::Find(P2DHandle body) const
+{
+    int index = P2DPool::GetIndex(body);
+    if(body == P2D_NULL_HANDLE || index >= poses.size())
+        return NULL;
+
+    const BodyPose* pose = poses.constData() + index;
+    return pose->body == body ? pose : NULL;
+}
+
+
+PhysicsThread::PhysicsThread(P2DScene* scene, QMutex* sceneMutex, float32 timeStep,
+                             int32 velocityIterations, int32 positionIterations, float32 stepBudget)
+    :scene(scene), sceneMutex(sceneMutex), timeStep(timeStep),
+      velocityIterations(velocityIterations), positionIterations(positionIterations),
+      stepBudget(stepBudget), running(1), stepCount(0), publishCount(0), backUnseen(false)
+{
+    memset(&stepReport, 0, sizeof(stepReport));
+    clock.start();
+
+    recorded.stepCount = 0;
+    recorded.time = 0;
+    memset(&recorded.stepReport, 0, sizeof(recorded.stepReport));
+    for(int i=0; i<3; i++){
+        snapshots[i].stepCount = 0;
+        snapshots[i].time = 0;
+        memset(&snapshots[i].stepReport, 0, sizeof(snapshots[i].stepReport));
+    }
+    frontIndex = 0;
+    spareIndex.store(1);
+    backIndex = 2;
+}
+
+PhysicsThread::~PhysicsThread()
+{
+    Stop();
+}
+
+void PhysicsThread::SetRunning(bool running)
+{
+    this->running.store(running ? 1 : 0);
+}
+
+void PhysicsThread::Stop()
+{
+    requestInterruption();
+    wait();
+}
+
+bool PhysicsThread::AcquireSnapshot()
+{
+    if((spareIndex.loadAcquire() & FRESH_SNAPSHOT) == 0)
+        return false;
+
+    // Hand the front buffer back as the spare one, it is no longer fresh.
+    frontIndex = spareIndex.fetchAndStoreOrdered(frontIndex) & SNAPSHOT_INDEX_MASK;
+    return true;
+}
+
+float32 PhysicsThread::GetInterpolation() const
+{
+    const qint64 period = (qint64)(timeStep * 1.0e9f);
+    qint64 elapsed = clock.nsecsElapsed() - snapshots[frontIndex].time;
+    if(elapsed <= 0)
+        return 0.0f;
+    if(elapsed >= period)
+        return 1.0f;
+    return (float32)elapsed / (float32)period;
+}
+
+void PhysicsThread::run()
+{
+    const qint64 period = (qint64)(timeStep * 1.0e9f);
+
+    // The clock time the simulation has caught up to. It only moves in
+    // whole steps, the remainder carries over to the next wake.
+    qint64 simulated = clock.nsecsElapsed();
+
+    while(!isInterruptionRequested()){
+        qint64 now = clock.nsecsElapsed();
+        if(running.load()){
+            int steps = 0;
+            while(now - simulated >= period && steps < MAX_STEPS_PER_WAKE){
+                // Lock each step on its own, so the GUI gets the scene in
+                // between while we catch up.
+                QMutexLocker locker(sceneMutex);
+                scene->Step(timeStep, velocityIterations, positionIterations,
+                            stepBudget, &stepReport);
+                stepCount++;
+                steps++;
+                simulated += period;
+                Record();
+            }
+
+            // Drop what we could not catch up with.
+            if(now - simulated >= period)
+                simulated = now;
+
+            // The snapshots are ours alone, publishing needs no lock.
+            if(steps > 0)
+                Publish(simulated);
+        } else {
+            // Keep publishing while paused so edits to the scene show up.
+            simulated = now;
+            {
+                QMutexLocker locker(sceneMutex);
+                Record();
+            }
+            Publish(simulated);
+        }
+
+        // Sleep until the next step is due.
+        qint64 wait = simulated + period - clock.nsecsElapsed();
+        if(wait > 0)
+            usleep((unsigned long)(wait / 1000));
+    }
+
+    // Hand our allocator caches and worker index over to the next thread.
+    P2DReleaseWorker();
+}
+
+void PhysicsThread::Record()
+{
+    int size = recording.poses.size();
+    BodyPose* poses = recording.poses.data();
+    for(int i=0; i<size; i++)
+        poses[i].body = P2D_NULL_HANDLE;
+
+    for(P2DBody* body = scene->GetBodyList(); body; body = body->GetNext()){
+        P2DHandle handle = body->GetHandle();
+        int index = P2DPool::GetIndex(handle);
+
+        // Body slots are reused, so this only grows while the scene does.
+        if(index >= size){
+            recording.poses.resize(index + 1);
+            poses = recording.poses.data();
+            for(int i=size; i<index; i++)
+                poses[i].body = P2D_NULL_HANDLE;
+            size = index + 1;
+        }
+
+        BodyPose& pose = poses[index];
+        pose.body = handle;
+        pose.position = body->GetPosition();
+        pose.angle = body->GetAngle();
+
+        const BodyPose* previous = recorded.Find(handle);
+        if(previous){
+            pose.previousPosition = previous->position;
+            pose.previousAngle = previous->angle;
+            if(!(pose.position == pose.previousPosition) || pose.angle != pose.previousAngle)
+                MarkMoved(index);
+        } else {
+            pose.previousPosition = pose.position;
+            pose.previousAngle = pose.angle;
+            MarkMoved(index);
+        }
+    }
+
+    recorded.poses.swap(recording.poses);
+    recorded.stepCount = stepCount;
+}
+
+void PhysicsThread::MarkMoved(int index)
+{
+    int size = movedMarks.size();
+    if(index >= size){
+        movedMarks.resize(index + 1);
+        quint64* marks = movedMarks.data();
+        for(int i=size; i<=index; i++)
+            marks[i] = 0;
+    }
+
+    quint64& mark = movedMarks.data()[index];
+    if(mark != publishCount + 1){
+        mark = publishCount + 1;
+        pendingMoved.append(index);
+    }
+}
+
+void PhysicsThread::Publish(qint64 time)
+{
+    PoseSnapshot& snapshot = snapshots[backIndex];
+
+    // The GUI never saw what moved in this buffer, pass it on.
+    if(backUnseen){
+        const int* moved = snapshot.moved.constData();
+        for(int i=0; i<snapshot.moved.size(); i++)
+            MarkMoved(moved[i]);
+    }
+    snapshot.moved.resize(pendingMoved.size());
+    memcpy(snapshot.moved.data(), pendingMoved.constData(), pendingMoved.size() * sizeof(int));
+    pendingMoved.resize(0);
+
+    // Copy rather than assign, sharing the data would make the next
+    // Record detach and allocate.
+    int size = recorded.poses.size();
+    snapshot.poses.resize(size);
+    memcpy(snapshot.poses.data(), recorded.poses.constData(), size * sizeof(BodyPose));
+    snapshot.stepCount = recorded.stepCount;
+    snapshot.time = time;
+    snapshot.stepReport = stepReport;
+
+    publishCount++;
+
+    int spare = spareIndex.fetchAndStoreOrdered(backIndex | FRESH_SNAPSHOT);
+    backIndex = spare & SNAPSHOT_INDEX_MASK;
+    backUnseen = (spare & FRESH_SNAPSHOT) != 0;
+}
@@ -0,0 +1,123 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "p2dengine/general/p2dmath.h"
+#include "p2dengine/general/p2dpool.h"
+#include "p2dengine/scene/p2dscenemanager.h"
+
+
+/// The pose of a body at the end of a step and at the end of the step
+/// before, in engine coordinates.
+struct BodyPose
+{
+    P2DHandle body;     ///< P2D_NULL_HANDLE if no body lives in this slot
+    P2DVec2 position;
+    float32 angle;
+    P2DVec2 previousPosition;   ///< same as position for a new body
+    float32 previousAngle;
+};
+
+/// The poses of all the bodies after one step, indexed by the slot index
+/// of the body handle.
+struct PoseSnapshot
+{
+    QVector<BodyPose> poses;
+    QVector<int> moved;     ///< slot indices of the bodies that moved since the last snapshot the GUI took
+    quint64 stepCount;      ///< the number of steps taken when this was published
+    qint64 time;            ///< the clock time the simulation had caught up to, in ns
+    P2DStepBudgetReport stepReport; ///< what the last step before this was published degraded
+
+    /// Get the pose of a body.
+    /// @return NULL if the body was not alive when this was published.
+    const BodyPose* Find(P2DHandle body) const;
+};
+
+
+/// Steps a scene on its own thread with a fixed time step and publishes the
+/// body poses after every batch of steps.
+/// The steps follow the wall clock: each wake runs as many steps as the
+/// elapsed time holds, at most MAX_STEPS_PER_WAKE. Time beyond that is
+/// dropped, so a scene slower than real time slows down instead of
+/// spiralling into ever longer batches.
+/// The poses are triple buffered: the thread fills a back buffer and swaps
+/// it with a spare one, the GUI thread swaps the spare one with its front
+/// buffer when it is newer. Neither side ever waits for the other.
+/// Each snapshot lists the bodies that moved, including those of snapshots
+/// the GUI skipped, so the items only need updating for those.
+/// Anything else that touches the scene must hold the scene mutex. The
+/// thread only holds it for one step at a time.
+class PhysicsThread : public QThread
+{
+public:
+    PhysicsThread(P2DScene* scene, QMutex* sceneMutex, float32 timeStep,
+                  int32 velocityIterations, int32 positionIterations, float32 stepBudget);
+    ~PhysicsThread();
+
+    /// Pause or resume the simulation. Poses are still published while
+    /// paused, so edits to the scene show up.
+    void SetRunning(bool running);
+
+    /// Make the newest published snapshot the front one.
+    /// Only call this from the GUI thread.
+    /// @return true if the front snapshot changed.
+    bool AcquireSnapshot();
+
+    /// Get the front snapshot. It stays valid until the next AcquireSnapshot.
+    /// Only call this from the GUI thread.
+    const PoseSnapshot& GetSnapshot() const {return snapshots[frontIndex];}
+
+    /// Get how far the clock is past the front snapshot, in steps within
+    /// [0,1]. Rendering the poses interpolated by this factor runs one step
+    /// behind the simulation but moves smoothly at any step rate.
+    /// Only call this from the GUI thread.
+    float32 GetInterpolation() const;
+
+    /// Ask the thread to finish and wait for it.
+    void Stop();
+
+protected:
+    void run();
+
+private:
+    void Record();
+    void MarkMoved(int index);
+    void Publish(qint64 time);
+
+    P2DScene* scene;
+    QMutex* sceneMutex;
+
+    float32 timeStep;
+    int32 velocityIterations;
+    int32 positionIterations;
+    float32 stepBudget;             ///< Wall clock budget of a step in ms
+    P2DStepBudgetReport stepReport; ///< What the last step degraded, published with the poses
+
+    QAtomicInt running;
+    quint64 stepCount;
+    QElapsedTimer clock;
+
+    // The poses after the last step and a buffer to record the next ones,
+    // only used by the physics thread.
+    PoseSnapshot recorded;
+    PoseSnapshot recording;
+
+    // The bodies that moved since the last publish. A body is marked with
+    // the publish it is listed for, so it is only listed once.
+    QVector<int> pendingMoved;
+    QVector<quint64> movedMarks;
+    quint64 publishCount;
+    bool backUnseen;        // the back buffer was published but never taken by the GUI
+
+    PoseSnapshot snapshots[3];
+    int backIndex;          // only used by the physics thread
+    int frontIndex;         // only used by the GUI thread
+    QAtomicInt spareIndex;  // the spare buffer, with FRESH_SNAPSHOT set if it is newer than the front
+};
+
+#endif // PHYSICSTHREAD_H
@@ -17,13 +17,17 @@ PolygonItem::PolygonItem(QColor color, QGraphicsScene *parent)
     setZValue(0);
 
     setFlags(ItemIsSelectable | ItemIsMovable);
-    setAcceptHoverEvents(true);
 
     useTexture = false;
+    hovered = false;
+    textureId = -1;
+    textureLevel = -1;
 
     timer.Reset();
 
-    body = NULL;
+    world = NULL;
+    bodyHandle = P2D_NULL_HANDLE;
+    bodyType = P2D_STATIC_BODY;
 
 /*
     qDebug()<<"input size"<<points.size();
@@ -53,10 +57,21 @@ PolygonItem::~PolygonItem()
 {
     // delete p2DPolygonObject;
     // delete transform;
-    if(body) body->GetWorld()->DestroyBody(body);
+    SceneManager* manager = static_cast<SceneManager*>(parentScene);
+    manager->GetTextureCache().Release(textureId);
+    if(bodyHandle != P2D_NULL_HANDLE)
+        manager->DetachBodyItem(this);
+    QMutexLocker locker(EngineMutex());
+    P2DBody* body = GetP2DBody();
+    if(body) world->DestroyBody(body);
     if(aabb) delete aabb;
 }
 
+QMutex* PolygonItem::EngineMutex() const
+{
+    return static_cast<SceneManager*>(parentScene)->GetEngineMutex();
+}
+
 QRectF PolygonItem::boundingRect() const
 {
     /*
@@ -92,13 +107,15 @@ void PolygonItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
         //qDebug()<<"get position"<<CoordinateInterface::MapToScene(body->GetPosition());
     }
 
-    QColor c = (option->state & QStyle::State_MouseOver && P2D_STATIC_BODY != body->GetType()) ?
-                QColor(color.red(),color.green(),color.blue(),70) : this->color;
+    // The pose is synced by SceneManager after each step, the body itself
+    // belongs to the physics thread.
+    if(bodyHandle == P2D_NULL_HANDLE) return;
 
-    this->setRotation(CoordinateInterface::RadToDeg(body->GetAngle()));
-    //qDebug()<<"paint position"<<CoordinateInterface::MapToScene(body->GetPosition());
-    //qDebug()<<"setpos"<<CoordinateInterface::MapToScene(P2DMul(body->GetTransform(), body->GetPosition()));
-    this->setPos(CoordinateInterface::MapToScene(body->GetPosition()));
+    // Plain bodies are drawn in one batch on a GL viewport.
+    SceneManager* manager = static_cast<SceneManager*>(parentScene);
+    if(!useTexture && manager->IsBatchDrawing()) return;
+
+    QColor c = GetDrawColor();
 
     /*
     this->setTransform(QTransform(cos(angle), sin(angle), position.x,
@@ -115,15 +132,23 @@ void PolygonItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
         //QPen pnew(QPen(QColor(0,0,0), 0, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
         //pnew.setCosmetic(true);
         painter->setPen(pnew);
-        QBrush *bnew;
-
 
-        if(useTexture){
-            bnew = new QBrush(texture);
+        // The brushes are kept across paints, a textured one is only
+        // fetched again when the zoom calls for another mip level.
+        if(useTexture && textureId >= 0){
+            TextureCache& cache = manager->GetTextureCache();
+            qreal scale = qSqrt(qAbs(painter->worldTransform().determinant()));
+            int level = cache.SelectLevel(textureId, scale);
+            if(level != textureLevel){
+                textureBrush = cache.GetBrush(textureId, level);
+                textureLevel = level;
+            }
+            painter->setBrush(textureBrush);
         } else {
-            bnew = new QBrush(c, Qt::SolidPattern);
+            if(fillBrush.style() != Qt::SolidPattern || fillBrush.color() != c)
+                fillBrush = QBrush(c, Qt::SolidPattern);
+            painter->setBrush(fillBrush);
         }
-        painter->setBrush(*bnew);
 
         painter->drawPath(path);
         painter->setPen(p);
@@ -133,6 +158,23 @@ void PolygonItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *optio
     }   
 }
 
+void PolygonItem::SetTexture(QImage& tex)
+{
+    TextureCache& cache = static_cast<SceneManager*>(parentScene)->GetTextureCache();
+    int id = cache.Acquire(tex);
+    cache.Release(textureId);
+    textureId = id;
+    textureLevel = -1;
+    textureBrush = QBrush();
+    update();
+}
+
+QColor PolygonItem::GetDrawColor() const
+{
+    return (hovered && P2D_STATIC_BODY != bodyType) ?
+                QColor(color.red(),color.green(),color.blue(),70) : this->color;
+}
+
 void PolygonItem::BindP2DBody(P2DScene* scene, QVector<QPointF> points, P2DBodyType bodyType, float restitution, float friction)
 {
     // Define the polygon shape for our dynamic body.
@@ -179,6 +221,8 @@ qDebug()<<"bounding area"<<(aabb->lowerBound.x - aabb->upperBound.x)*(aabb->lowe
     for (int i = 1; i < count; ++i)
         path.lineTo(CoordinateInterface::MapToScene(polygonObject.GetVertex(i)));
     path.lineTo(CoordinateInterface::MapToScene(polygonObject.GetVertex(0)));
+    for (int i = 0; i < count; ++i)
+        outline.push_back(CoordinateInterface::MapToScene(polygonObject.GetVertex(i)));
 
 
 
@@ -187,7 +231,12 @@ qDebug()<<"bounding area"<<(aabb->lowerBound.x - aabb->upperBound.x)*(aabb->lowe
     bodyDef.type = bodyType;
     P2DVec2 c = CoordinateInterface::MapToEngine(QPointF(centroid.x, centroid.y));
     bodyDef.position.Set(c.x, c.y);
-    body = scene->CreateBody(&bodyDef);
+    QMutexLocker locker(EngineMutex());
+    P2DBody* body = scene->CreateBody(&bodyDef);
+    world = scene;
+    bodyHandle = body->GetHandle();
+    this->bodyType = bodyType;
+    static_cast<SceneManager*>(parentScene)->AttachBodyItem(this);
 
 
     // Define the dynamic body fixture.
@@ -215,8 +264,17 @@ qDebug()<<"bounding area"<<(aabb->lowerBound.x - aabb->upperBound.x)*(aabb->lowe
     */
 }
 
+void PolygonItem::SetPose(const P2DVec2& position, float32 angle)
+{
+    setRotation(CoordinateInterface::RadToDeg(angle));
+    setPos(CoordinateInterface::MapToScene(position));
+}
+
 void PolygonItem::Translate(QPointF translate)
 {
+    QMutexLocker locker(EngineMutex());
+    P2DBody* body = GetP2DBody();
+    if(!body) return;
     P2DTransform xf = body->GetTransform();
     body->SetTransform(CoordinateInterface::MapToEngine(CoordinateInterface::MapToScene(xf.position) + translate),
                        xf.rotation.GetAngle());
@@ -224,6 +282,9 @@ void PolygonItem::Translate(QPointF translate)
 
 void PolygonItem::Rotate(double deg)
 {
+    QMutexLocker locker(EngineMutex());
+    P2DBody* body = GetP2DBody();
+    if(!body) return;
     P2DTransform xf = body->GetTransform();
     xf.SetAngle(CoordinateInterface::DegToRad(deg));
     body->SetTransform(xf.position, xf.rotation.GetAngle());
@@ -231,8 +292,12 @@ void PolygonItem::Rotate(double deg)
 
 void PolygonItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
-    if(P2D_STATIC_BODY != body->GetType())
-        body->SetActive(false);
+    {
+        QMutexLocker locker(EngineMutex());
+        P2DBody* body = GetP2DBody();
+        if(body && P2D_STATIC_BODY != body->GetType())
+            body->SetActive(false);
+    }
 
     QGraphicsItem::mousePressEvent(event);
     update();
@@ -241,13 +306,22 @@ void PolygonItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
 void PolygonItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 {
     // Ignore event if it is not dynamic body.
-    if(P2D_DYNAMIC_BODY != body->GetType()) {
+    if(P2D_DYNAMIC_BODY != bodyType) {
         event->accept();
         return;
     }
 
-    // Note event->pos() returns the mouse cursor position in item coordinates.
-    body->SetTransform(CoordinateInterface::MapToEngine(QGraphicsItem::mapToScene(event->pos())), body->GetAngle());
+    {
+        QMutexLocker locker(EngineMutex());
+        P2DBody* body = GetP2DBody();
+        if(!body) {
+            event->accept();
+            return;
+        }
+
+        // Note event->pos() returns the mouse cursor position in item coordinates.
+        body->SetTransform(CoordinateInterface::MapToEngine(QGraphicsItem::mapToScene(event->pos())), body->GetAngle());
+    }
 
     //qDebug()<<"should be at"<<CoordinateInterface::MapToEngine(event->pos()).x<<CoordinateInterface::MapToEngine(event->pos()).y;
     //qDebug()<<"actual at"<<body->GetPosition().x<<body->GetPosition().y;
@@ -266,7 +340,11 @@ void PolygonItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 
 void PolygonItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
-    body->SetActive(true);
+    {
+        QMutexLocker locker(EngineMutex());
+        P2DBody* body = GetP2DBody();
+        if(body) body->SetActive(true);
+    }
 
     QGraphicsItem::mouseReleaseEvent(event);
     update();
@@ -299,6 +377,7 @@ void PolygonItem::contextMenuEvent(QGraphicsSceneContextMenuEvent *event)
     } else if(selectedAction == isUseTextureAction){
         useTexture = !useTexture;
         isUseTextureAction->setChecked(useTexture);
+        static_cast<SceneManager*>(parentScene)->InvalidateBodyBatch();
         //editTextureAction->setEnabled(isUseTextureAction->isChecked());
     } else if(selectedAction == editTextureAction){
         //static_cast<SceneManager*>(parentScene)->toggleEngine();
@@ -3,6 +3,8 @@
 
 #include <QColor>
 #include <QGraphicsItem>
+#include <QBrush>
+#include <QMutex>
 
 #include "params.h"
 
@@ -24,10 +26,22 @@ public:
 public: /*Related to p2dengine*/
     void BindP2DBody(P2DScene *scene, QVector<QPointF> points,
                      P2DBodyType bodyType = P2D_DYNAMIC_BODY, float restitution=0.2, float friction = 0.5);
-    P2DBody* GetP2DBody(){return body;}
-    void SetTexture(QImage& tex) {
-        texture = (tex.copy(0,0,tex.width(),tex.height()));
-    }
+    // Returns NULL once the body is destroyed. The P2DScene itself must outlive
+    // the item, SceneManager deletes all the items before it deletes the scene.
+    P2DBody* GetP2DBody() const {return world ? world->GetBody(bodyHandle) : NULL;}
+    P2DHandle GetBodyHandle() const {return bodyHandle;}
+    /// Place the item at a pose of its body, in engine coordinates.
+    void SetPose(const P2DVec2& position, float32 angle);
+    /// Set by SceneManager, which finds the item under the mouse itself.
+    void SetHovered(bool hovered) {this->hovered = hovered; update();}
+
+    /// The outline of the shape around the item origin, in scene units.
+    const QVector<QPointF>& GetOutline() const {return outline;}
+    /// The fill colour, including the hover highlight.
+    QColor GetDrawColor() const;
+    bool UsesTexture() const {return useTexture;}
+    /// Texture the item with an image, shared with identical ones, see TextureCache.
+    void SetTexture(QImage& tex);
 
     void Translate(QPointF translate);
     void Rotate(double deg);
@@ -45,14 +59,25 @@ private:
     int y;
     QColor color;
     QPainterPath path;
+    QVector<QPointF> outline;
 
-    QImage texture;
+    int textureId;          // in the TextureCache of the scene, -1 for none
+    int textureLevel;       // the mip level textureBrush is of, -1 if not picked yet
+    QBrush textureBrush;
+    QBrush fillBrush;
     bool useTexture;
+    bool hovered;
 
 private: /*Related to p2dengine*/
-    P2DBody* body;
+    // Keep a handle rather than a pointer, a stale handle is detected.
+    P2DScene* world;
+    P2DHandle bodyHandle;
+    P2DBodyType bodyType;  // cached so painting never touches the engine
     P2DAABB *aabb;
 
+    // The lock to hold while touching the body, see SceneManager::GetEngineMutex.
+    QMutex* EngineMutex() const;
+
 
 private: /*timing*/
     P2DTimer timer;
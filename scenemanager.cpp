@@ -2,10 +2,23 @@
 
 #include "utils.h"
 
+// Show items a little before they enter the view, they trail the engine by up to a step.
+static const qreal CULL_MARGIN = 100;
+
 SceneManager::SceneManager()
+    :engineMutex(QMutex::Recursive)
 {
     isDrawing = false;
     isEngineRunning = true;
+    renderAlpha = 1.0f;
+    hoverBody = P2D_NULL_HANDLE;
+    batchDrawing = false;
+    cullPass = 0;
+    queryBuffer.resize(256);
+
+    // Moving items would update a BSP index every frame. Picking, hover and
+    // culling are answered by the engine's broad-phase instead.
+    setItemIndexMethod(QGraphicsScene::NoIndex);
 
     InitP2DEngine();
 
@@ -22,20 +35,32 @@ SceneManager::~SceneManager()
     if(item) delete item;
     if(drawingItem) delete drawingItem;
     if(polyItem) delete polyItem;
+
+    // Stop stepping before the bodies go away with their items.
+    physics->Stop();
+    delete physics;
+    ClearScene();
+    // The items keep a pointer to the scene, none may be left to use it.
+    Q_ASSERT(items().isEmpty());
     if(scene) delete scene;
 }
 
 
 void SceneManager::Render()
 {
-    // Instruct the scene to perform a single step of simulation.
-    // It is generally best to keep the time step and iterations fixed.
-    if(isEngineRunning && this->isActive())
-        scene->Step(timeStep, velocityIterations, positionIterations);
+    // The scene is stepped by the physics thread, only pause it while the
+    // scene is not shown. The items that moved are synced to the latest
+    // published poses here, so painting never changes the scene index.
+    physics->SetRunning(isEngineRunning && this->isActive());
+    bool snapshotChanged = physics->AcquireSnapshot();
+    renderAlpha = physics->GetInterpolation();
+    SyncItems(snapshotChanged);
+    CullItems();
 
 
 #define DEBUG 0
 #if DEBUG
+    QMutexLocker locker(&engineMutex);
     int i=0;
     for(P2DBody* bodyList = scene->GetBodyList();
         bodyList; bodyList = bodyList->GetNext(), i++)
@@ -68,6 +93,198 @@ void SceneManager::Render()
     return;
 }
 
+void SceneManager::AttachBodyItem(PolygonItem* item)
+{
+    int index = P2DPool::GetIndex(item->GetBodyHandle());
+    if(index >= bodyItems.size())
+        bodyItems.resize(index + 1);
+    bodyItems[index] = item;
+
+    // Shown until the next cull pass says otherwise.
+    visibleSlots.append(index);
+    InvalidateBodyBatch();
+}
+
+void SceneManager::DetachBodyItem(PolygonItem* item)
+{
+    int index = P2DPool::GetIndex(item->GetBodyHandle());
+    if(index < bodyItems.size() && bodyItems.at(index) == item)
+        bodyItems[index] = NULL;
+    InvalidateBodyBatch();
+}
+
+void SceneManager::InvalidateBodyBatch()
+{
+#ifndef QT_NO_OPENGL
+    bodyRenderer.Invalidate();
+#endif
+}
+
+void SceneManager::drawBackground(QPainter *painter, const QRectF &rect)
+{
+    QGraphicsScene::drawBackground(painter, rect);
+
+    // On a GL viewport the plain bodies are drawn here in one batch, the
+    // items only paint themselves elsewhere, e.g. when printing.
+    batchDrawing = false;
+#ifndef QT_NO_OPENGL
+    if(painter->paintEngine()->type() == QPaintEngine::OpenGL2){
+        painter->beginNativePainting();
+        batchDrawing = bodyRenderer.Draw(painter->worldTransform(),
+                                         painter->device()->width(), painter->device()->height(),
+                                         bodyItems, physics->GetSnapshot(), renderAlpha);
+        painter->endNativePainting();
+    }
+#endif
+}
+
+PolygonItem* SceneManager::FindBodyItem(P2DHandle body) const
+{
+    int index = P2DPool::GetIndex(body);
+    if(body == P2D_NULL_HANDLE || index >= bodyItems.size())
+        return NULL;
+
+    PolygonItem* item = bodyItems.at(index);
+    return item && item->GetBodyHandle() == body ? item : NULL;
+}
+
+PolygonItem* SceneManager::PickItem(QPointF scenePos)
+{
+    QMutexLocker locker(&engineMutex);
+    return PickItemLocked(scenePos);
+}
+
+PolygonItem* SceneManager::PickItemLocked(QPointF scenePos)
+{
+    P2DVec2 point = CoordinateInterface::MapToEngine(scenePos);
+    bool truncated;
+    int32 count = scene->QueryPoint(point, queryBuffer.data(), queryBuffer.size(), true, &truncated);
+    while(truncated){
+        queryBuffer.resize(2 * queryBuffer.size());
+        count = scene->QueryPoint(point, queryBuffer.data(), queryBuffer.size(), true, &truncated);
+    }
+
+    PolygonItem* picked = NULL;
+    for(int32 i=0; i<count; i++){
+        P2DFixture* fixture = scene->GetFixture(queryBuffer.at(i));
+        if(!fixture) continue;
+        PolygonItem* item = FindBodyItem(fixture->GetBody()->GetHandle());
+        if(item && (!picked || item->zValue() > picked->zValue()))
+            picked = item;
+    }
+    return picked;
+}
+
+void SceneManager::UpdateHover(QPointF scenePos)
+{
+    // Don't wait for a step to finish, the next move catches up.
+    if(!engineMutex.tryLock()) return;
+    PolygonItem* item = PickItemLocked(scenePos);
+    engineMutex.unlock();
+
+    P2DHandle body = item ? item->GetBodyHandle() : P2D_NULL_HANDLE;
+    if(body == hoverBody) return;
+
+    PolygonItem* previous = FindBodyItem(hoverBody);
+    if(previous) previous->SetHovered(false);
+    if(item) item->SetHovered(true);
+    hoverBody = body;
+}
+
+void SceneManager::CullItems()
+{
+    QRectF visible;
+    foreach(QGraphicsView* view, views())
+        visible |= view->mapToScene(view->viewport()->rect()).boundingRect();
+    if(visible.isEmpty()) return;
+    visible.adjust(-CULL_MARGIN, -CULL_MARGIN, CULL_MARGIN, CULL_MARGIN);
+
+    P2DAABB aabb;
+    aabb.lowerBound = CoordinateInterface::MapToEngine(visible.topLeft());
+    aabb.upperBound = CoordinateInterface::MapToEngine(visible.bottomRight());
+
+    // Keep the last frame's visibility rather than wait for a step to finish.
+    if(!engineMutex.tryLock()) return;
+
+    // The fat AABBs are close enough for visibility, skip the exact test.
+    bool truncated;
+    int32 count = scene->QueryAABB(aabb, queryBuffer.data(), queryBuffer.size(), false, &truncated);
+    while(truncated){
+        queryBuffer.resize(2 * queryBuffer.size());
+        count = scene->QueryAABB(aabb, queryBuffer.data(), queryBuffer.size(), false, &truncated);
+    }
+
+    cullPass++;
+    if(visibleMarks.size() < bodyItems.size())
+        visibleMarks.resize(bodyItems.size());
+
+    for(int32 i=0; i<count; i++){
+        P2DFixture* fixture = scene->GetFixture(queryBuffer.at(i));
+        if(!fixture) continue;
+        P2DHandle body = fixture->GetBody()->GetHandle();
+        PolygonItem* item = FindBodyItem(body);
+        if(!item) continue;
+
+        int index = P2DPool::GetIndex(body);
+        if(visibleMarks.at(index) == cullPass) continue;
+        visibleMarks[index] = cullPass;
+        nextVisibleSlots.append(index);
+        if(!item->isVisible()) item->setVisible(true);
+    }
+    engineMutex.unlock();
+
+    // Hide what left the view. A dragged body has no proxy, keep it shown.
+    for(int i=0; i<visibleSlots.size(); i++){
+        int index = visibleSlots.at(i);
+        if(index < visibleMarks.size() && visibleMarks.at(index) == cullPass) continue;
+        PolygonItem* item = bodyItems.value(index, NULL);
+        if(!item) continue;
+        if(item == mouseGrabberItem())
+            nextVisibleSlots.append(index);
+        else
+            item->setVisible(false);
+    }
+
+    visibleSlots.swap(nextVisibleSlots);
+    nextVisibleSlots.resize(0);
+}
+
+void SceneManager::SyncItems(bool snapshotChanged)
+{
+    const QVector<int>& moved = physics->GetSnapshot().moved;
+
+    // The items that moved in the snapshot before were drawn part way,
+    // put those that stopped since at their final pose.
+    if(snapshotChanged){
+        SyncItems(syncedMoved);
+        syncedMoved.resize(moved.size());
+        memcpy(syncedMoved.data(), moved.constData(), moved.size() * sizeof(int));
+    }
+
+    // Those that moved keep moving with the interpolation every frame.
+    SyncItems(moved);
+}
+
+void SceneManager::SyncItems(const QVector<int>& moved)
+{
+    const QVector<BodyPose>& poses = physics->GetSnapshot().poses;
+    for(int i=0; i<moved.size(); i++){
+        int index = moved.at(i);
+        if(index >= poses.size() || index >= bodyItems.size())
+            continue;
+
+        const BodyPose& pose = poses.at(index);
+        PolygonItem* item = bodyItems.at(index);
+        if(pose.body == P2D_NULL_HANDLE || !item || item->GetBodyHandle() != pose.body)
+            continue;
+
+        // Angles are not wrapped, so they interpolate like positions.
+        P2DVec2 position = (1.0f - renderAlpha) * pose.previousPosition + renderAlpha * pose.position;
+        float32 angle = (1.0f - renderAlpha) * pose.previousAngle + renderAlpha * pose.angle;
+        item->SetPose(position, angle);
+    }
+}
+
 void SceneManager::toggleEngine()
 {
     isEngineRunning = ! isEngineRunning;
@@ -77,10 +294,14 @@ void SceneManager::InitP2DEngine()
 {
     // Prepare for simulation. Typically we use a time step of 1/60 of a
     // second (60Hz) and 10 iterations. This provides a high quality simulation
-    // in most game scenarios.
-    timeStep = 1.0f / 60.0f;
-    velocityIterations = 6;
-    positionIterations = 2;
+    // in most game scenarios. The items are interpolated between steps, so
+    // they move smoothly on displays that refresh faster than that.
+    float32 timeStep = 1.0f / 60.0f;
+    int32 velocityIterations = 6;
+    int32 positionIterations = 2;
+
+    // Leave the physics thread some slack within its period.
+    float32 stepBudget = 12.0f;
 
 
     // Define the gravity vector.
@@ -90,6 +311,11 @@ void SceneManager::InitP2DEngine()
 
     LoadGround();
 
+    // Step on a thread of its own so slow steps and slow paints don't hold up each other.
+    physics = new PhysicsThread(scene, &engineMutex, timeStep,
+                                velocityIterations, positionIterations, stepBudget);
+    physics->start();
+
     /*
     // Define the ground body.
     P2DBodyDef groundBodyDef;
@@ -130,6 +356,8 @@ void SceneManager::InitP2DEngine()
 
 void SceneManager::ClearScene()
 {
+    // Hold the engine across the whole batch rather than once per item.
+    QMutexLocker locker(&engineMutex);
     QList<QGraphicsItem *> allItems;
     allItems = this->items();
     foreach(QGraphicsItem* item, allItems){
@@ -144,7 +372,7 @@ void SceneManager::ClearScene()
 
 void SceneManager::contextMenuEvent(QGraphicsSceneContextMenuEvent* e)
 {
-    if(itemAt(e->scenePos(), QTransform()) == NULL){
+    if(PickItem(e->scenePos()) == NULL){
         QMenu menu;
         QAction *clearAction = menu.addAction("Clear Scene");
 
@@ -166,7 +394,7 @@ void SceneManager::keyPressEvent(QKeyEvent *e)
 void SceneManager::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
     // We can only draw in a blank area.
-    if(event->button() == Qt::LeftButton && itemAt(event->scenePos(), QTransform()) == NULL){
+    if(event->button() == Qt::LeftButton && PickItem(event->scenePos()) == NULL){
         isDrawing = true;
         drawingItem = new DrawingPolygonItem(QColor(qrand()%255, qrand()%255, qrand()%255), event->scenePos());
         addItem(drawingItem);
@@ -180,6 +408,8 @@ void SceneManager::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 {
     if(isDrawing){
         drawingItem->AddPoint(event->scenePos());
+    } else if(event->buttons() == Qt::NoButton){
+        UpdateHover(event->scenePos());
     }
 
     QGraphicsScene::mouseMoveEvent(event);
@@ -207,6 +437,7 @@ void SceneManager::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 
 void SceneManager::LoadGround(void)
 {
+    QMutexLocker locker(&engineMutex);
     ClearScene();
     // Add the ground body.
     polyItem = new PolygonItem(QColor(21,25,123), this);
@@ -221,6 +452,7 @@ void SceneManager::LoadGround(void)
 
 void SceneManager::LoadBouncingBall(void)
 {
+    QMutexLocker locker(&engineMutex);
     LoadGround();
 
     // Add balls.
@@ -239,6 +471,7 @@ void SceneManager::LoadBouncingBall(void)
 
 void SceneManager::LoadDomino(void)
 {
+    QMutexLocker locker(&engineMutex);
     LoadGround();
 
     // Add dominoes.
@@ -259,6 +492,7 @@ void SceneManager::LoadDomino(void)
 
 void SceneManager::LoadSlide(void)
 {
+    QMutexLocker locker(&engineMutex);
     LoadGround();
 
     // Add a box.
@@ -310,6 +544,7 @@ void SceneManager::LoadSlide(void)
 
 void SceneManager::LoadLever()
 {
+    QMutexLocker locker(&engineMutex);
     LoadGround();
 
     // Add a support point.
@@ -337,6 +572,7 @@ void SceneManager::LoadLever()
 
 void SceneManager::LoadManyMany()
 {
+    QMutexLocker locker(&engineMutex);
     LoadGround();
 
     QVector<QPointF> points;
@@ -5,11 +5,15 @@
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QTimer>
+#include <QMutex>
 #include <QFile>
 #include <QPainter>
 
 #include "playground.h"
 #include "polygonitem.h"
+#include "physicsthread.h"
+#include "bodyrenderer.h"
+#include "texturecache.h"
 
 #include "p2dengine/general/p2dmath.h"
 #include "p2dengine/general/p2dtimer.h"
@@ -33,6 +37,31 @@ public:
     void Render();
     void toggleEngine();
 
+    /// Guards the engine scene against the physics thread. Hold it while
+    /// touching bodies from the GUI thread. It is recursive, so a batch of
+    /// edits can hold it around the per item locks.
+    QMutex* GetEngineMutex() {return &engineMutex;}
+
+    /// Let the sync pass after each step find the item of a bound body.
+    void AttachBodyItem(PolygonItem* item);
+    void DetachBodyItem(PolygonItem* item);
+
+    /// Get the topmost item whose body contains a scene point. The scene
+    /// keeps no index of its own, this asks the engine's broad-phase.
+    PolygonItem* PickItem(QPointF scenePos);
+
+    /// True while the current paint draws the plain bodies in one batch,
+    /// their items skip painting then.
+    bool IsBatchDrawing() const {return batchDrawing;}
+    /// Call when an item changes how it is drawn, e.g. toggles its texture.
+    void InvalidateBodyBatch();
+
+    /// What the step behind the shown poses gave up to stay within its budget.
+    const P2DStepBudgetReport& GetStepReport() const {return physics->GetSnapshot().stepReport;}
+
+    /// The textures of the items, shared between identical images.
+    TextureCache& GetTextureCache() {return textureCache;}
+
 
 private:
     QGraphicsItem *item;
@@ -48,15 +77,42 @@ private: /*Related to p2dengine*/
     P2DScene* scene;
     P2DBody* body;
 
-    float32 timeStep;
-    int32 velocityIterations;
-    int32 positionIterations;
+    QMutex engineMutex;
+    PhysicsThread* physics;  ///< Steps the scene, see SyncItems
+    float32 renderAlpha;     ///< Interpolation factor of the current frame
+
+    QVector<PolygonItem*> bodyItems;  ///< Indexed by the slot index of the body handle
+    QVector<int> syncedMoved;         ///< The moved list of the snapshot synced before
+
+    void SyncItems(bool snapshotChanged);
+    void SyncItems(const QVector<int>& moved);
+
+    PolygonItem* FindBodyItem(P2DHandle body) const;
+    PolygonItem* PickItemLocked(QPointF scenePos);
+    void UpdateHover(QPointF scenePos);
+    void CullItems();
+
+    P2DHandle hoverBody;              ///< The body of the item under the mouse
+
+    QVector<P2DHandle> queryBuffer;   ///< Fixtures reported by the culling and picking queries
+    QVector<quint32> visibleMarks;    ///< The last cull pass that saw each body slot
+    quint32 cullPass;
+    QVector<int> visibleSlots;        ///< The body slots whose items are shown
+    QVector<int> nextVisibleSlots;
+
+#ifndef QT_NO_OPENGL
+    BodyRenderer bodyRenderer;        ///< Draws the plain bodies on a GL viewport
+#endif
+    bool batchDrawing;
+
+    TextureCache textureCache;
 
     void InitP2DEngine();
     void ClearScene();
 
 
 protected:
+    void drawBackground(QPainter *painter, const QRectF &rect);
     void mousePressEvent(QGraphicsSceneMouseEvent *event);
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
     void mouseReleaseEvent(QGraphicsSceneMouseEvent *event);
@@ -0,0 +1,122 @@
+#include "stackbenchmark.h"
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "p2dengine/collision/p2dcontact.h"
+#include "p2dengine/objects/p2dpolygonobject.h"
+#include "p2dengine/scene/p2dbody.h"
+#include "p2dengine/scene/p2dscenemanager.h"
+
+static const float32 BOX_HALF_SIZE = 0.08f;
+static const float32 TIME_STEP = 1.0f / 60.0f;
+static const int STEP_COUNT = 600;
+
+// A solver setup to run. subSteps is 0 for P2DContactSolver.
+struct StackRun
+{
+    int subSteps;
+    int velocityIterations;
+    int positionIterations;
+};
+
+static const StackRun STACK_RUNS[] = {
+    {0, 6, 2},
+    {0, 10, 4},
+    {0, 20, 8},
+    {2, 1, 0},
+    {4, 1, 0},
+    {8, 1, 0},
+};
+
+
+static void BuildPyramid(P2DScene* scene, int rows)
+{
+    P2DBodyDef groundDef;
+    P2DBody* ground = scene->CreateBody(&groundDef);
+    P2DPolygonObject groundShape;
+    groundShape.SetARect(4.5f, 0.1f, P2DVec2(0.0f, 4.0f), 0.0f);
+    ground->CreateFixture(&groundShape, 0.0f);
+
+    P2DPolygonObject box;
+    box.SetARect(BOX_HALF_SIZE, BOX_HALF_SIZE);
+    for(int i=0; i<rows; i++){
+        for(int j=i; j<rows; j++){
+            P2DBodyDef bodyDef;
+            bodyDef.type = P2D_DYNAMIC_BODY;
+            bodyDef.position.Set((j - 0.5f*i - 0.5f*rows) * 2.1f*BOX_HALF_SIZE,
+                                 3.9f - BOX_HALF_SIZE - i*2.0f*BOX_HALF_SIZE);
+            P2DBody* body = scene->CreateBody(&bodyDef);
+
+            P2DFixtureDef fixtureDef;
+            fixtureDef.shape = &box;
+            fixtureDef.density = 1.0f;
+            fixtureDef.friction = 0.6f;
+            body->CreateFixture(&fixtureDef);
+        }
+    }
+}
+
+static QString RunStack(const StackRun& run, int rows)
+{
+    P2DScene scene(P2DVec2(0.0f, 10.0f));
+    if(run.subSteps > 0){
+        scene.SetSoftStepping(true);
+        scene.SetSoftSubStepCount(run.subSteps);
+    }
+    BuildPyramid(&scene, rows);
+
+    QVector<float32> startX;
+    for(P2DBody* body = scene.GetBodyList(); body; body = body->GetNext())
+        startX.append(body->GetPosition().x);
+
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    for(int i=0; i<STEP_COUNT; i++){
+        timer.start();
+        scene.Step(TIME_STEP, run.velocityIterations, run.positionIterations);
+        elapsed += timer.nsecsElapsed();
+    }
+
+    float32 sumSlide = 0.0f, maxSlide = 0.0f;
+    int dynamicCount = 0, awakeCount = 0, index = 0;
+    for(P2DBody* body = scene.GetBodyList(); body; body = body->GetNext(), index++){
+        if(body->GetType() != P2D_DYNAMIC_BODY)
+            continue;
+        float32 slide = P2DAbs(body->GetPosition().x - startX.at(index));
+        sumSlide += slide;
+        maxSlide = P2DMax(maxSlide, slide);
+        dynamicCount++;
+        if(body->IsAwake())
+            awakeCount++;
+    }
+
+    float32 deepest = 0.0f;
+    for(P2DContact* contact = scene.GetContactList(); contact; contact = contact->GetNext()){
+        if(!contact->IsTouching())
+            continue;
+        P2DSceneManifold manifold;
+        contact->GetSceneManifold(&manifold);
+        for(int i=0; i<contact->GetManifold()->pointCount; i++)
+            deepest = P2DMin(deepest, manifold.separations[i]);
+    }
+
+    QString solver = run.subSteps > 0
+            ? QString("soft, %1 sub-steps").arg(run.subSteps)
+            : QString("iterations %1/%2").arg(run.velocityIterations).arg(run.positionIterations);
+    return QString("%1: %2 ms, slide mean %3 max %4, deepest overlap %5, %6 awake")
+            .arg(solver, -20)
+            .arg(elapsed / 1.0e6, 0, 'f', 1)
+            .arg(sumSlide / P2DMax(dynamicCount, 1), 0, 'f', 4)
+            .arg(maxSlide, 0, 'f', 4)
+            .arg(-deepest, 0, 'f', 4)
+            .arg(awakeCount);
+}
+
+QString RunStackBenchmark(int rows)
+{
+    QString report = QString("Pyramid of %1 rows, %2 steps\n").arg(rows).arg(STEP_COUNT);
+    for(unsigned i=0; i<sizeof(STACK_RUNS)/sizeof(STACK_RUNS[0]); i++)
+        report += RunStack(STACK_RUNS[i], rows) + "\n";
+    return report;
+}
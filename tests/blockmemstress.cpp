@@ -0,0 +1,208 @@
+// Stress test of P2DBlockMem shared by many threads.
+// Up to P2D_MAX_WORKERS threads at a time get worker caches, the rest go
+// through the locked shared pool, and blocks are freed by other threads than
+// the ones that allocated them. The exiting threads release their worker
+// index, afterwards all of them must be free again.
+// Build it from the repository root with a sanitizer, e.g.
+//
+//   g++ -g -O1 -fsanitize=thread -I . tests/blockmemstress.cpp p2dengine/general/p2dmem.cpp p2dengine/general/p2dthread.cpp -lpthread
+//
+// or -fsanitize=address, and run it. It prints "ok" and exits with 0 on success.
+
+#include "p2dengine/general/p2dmem.h"
+#include "p2dengine/general/p2dthread.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STRESS_THREADS (P2D_MAX_WORKERS + 4)
+#define STRESS_ITERATIONS 200000
+#define STRESS_LIVE_BLOCKS 512
+#define STRESS_HANDOFF_BLOCKS 64
+
+struct StressBlock
+{
+	uint8* p;
+	int32 size;
+};
+
+static P2DBlockMem s_allocator;
+
+// Blocks passed from every thread to the next one, which frees them.
+static StressBlock s_handoff[STRESS_THREADS][STRESS_HANDOFF_BLOCKS];
+static int32 s_handoffCounts[STRESS_THREADS];
+static P2DMutex s_handoffMutex;
+
+static volatile int32 s_errors = 0;
+
+static uint32 Random(uint32* seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+static void Fill(const StressBlock& block, uint8 value)
+{
+	memset(block.p, value, block.size);
+}
+
+static void Check(const StressBlock& block, uint8 value)
+{
+	for (int32 i = 0; i < block.size; ++i)
+	{
+		if (block.p[i] != value)
+		{
+			P2DAtomicAdd(&s_errors, 1);
+			return;
+		}
+	}
+}
+
+static void* Work(void* arg)
+{
+	int32 thread = (int32)(size_t)arg;
+	uint8 mark = (uint8)(thread + 1);
+	uint32 seed = 7 * thread + 1;
+
+	StressBlock live[STRESS_LIVE_BLOCKS];
+	int32 liveCount = 0;
+
+	for (int32 i = 0; i < STRESS_ITERATIONS; ++i)
+	{
+		uint32 r = Random(&seed);
+		if (liveCount < STRESS_LIVE_BLOCKS && (liveCount < STRESS_LIVE_BLOCKS / 2 || (r & 1)))
+		{
+			StressBlock block;
+			block.size = 1 + (int32)(r % MAX_BLOCK_SIZE);
+			block.p = (uint8*)s_allocator.Allocate(block.size);
+			Fill(block, mark);
+			live[liveCount++] = block;
+		}
+		else
+		{
+			int32 k = (int32)((r >> 3) % liveCount);
+			StressBlock block = live[k];
+			live[k] = live[--liveCount];
+			Check(block, mark);
+
+			// Every so often hand the block to the next thread instead.
+			int32 next = (thread + 1) % STRESS_THREADS;
+			bool handedOff = false;
+			if ((r & 6) == 0)
+			{
+				P2DScopedLock lock(&s_handoffMutex);
+				if (s_handoffCounts[next] < STRESS_HANDOFF_BLOCKS)
+				{
+					Fill(block, 0xab);
+					s_handoff[next][s_handoffCounts[next]++] = block;
+					handedOff = true;
+				}
+			}
+
+			if (handedOff == false)
+			{
+				s_allocator.Free(block.p, block.size);
+			}
+		}
+
+		// Free what the previous thread handed over.
+		if ((i & 255) == 0)
+		{
+			P2DScopedLock lock(&s_handoffMutex);
+			for (int32 j = 0; j < s_handoffCounts[thread]; ++j)
+			{
+				Check(s_handoff[thread][j], 0xab);
+				s_allocator.Free(s_handoff[thread][j].p, s_handoff[thread][j].size);
+			}
+			s_handoffCounts[thread] = 0;
+		}
+	}
+
+	for (int32 i = 0; i < liveCount; ++i)
+	{
+		Check(live[i], mark);
+		s_allocator.Free(live[i].p, live[i].size);
+	}
+
+	P2DReleaseWorker();
+	return NULL;
+}
+
+static pthread_barrier_t s_claimBarrier;
+
+// Holds a worker index until every other claiming thread has one too.
+static void* Claim(void* arg)
+{
+	int32* index = (int32*)arg;
+	*index = P2DGetWorkerIndex();
+	pthread_barrier_wait(&s_claimBarrier);
+	P2DReleaseWorker();
+	return NULL;
+}
+
+int main()
+{
+	pthread_t threads[STRESS_THREADS];
+	for (int32 i = 0; i < STRESS_THREADS; ++i)
+	{
+		pthread_create(threads + i, NULL, Work, (void*)(size_t)i);
+	}
+	for (int32 i = 0; i < STRESS_THREADS; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	// The last hand-offs have nobody left to free them.
+	for (int32 i = 0; i < STRESS_THREADS; ++i)
+	{
+		for (int32 j = 0; j < s_handoffCounts[i]; ++j)
+		{
+			Check(s_handoff[i][j], 0xab);
+			s_allocator.Free(s_handoff[i][j].p, s_handoff[i][j].size);
+		}
+	}
+
+	// The exited threads flushed their caches and gave their indices back,
+	// the main thread took one for the last hand-offs.
+	P2DReleaseWorker();
+	int32 used = 0;
+	int32 cached = 0;
+	for (int32 i = 0; i < BLOCK_SIZES; ++i)
+	{
+		used += s_allocator.GetStats(i).usedBlocks;
+		cached += s_allocator.GetStats(i).cachedBlocks;
+	}
+
+	pthread_t claimers[P2D_MAX_WORKERS];
+	int32 indices[P2D_MAX_WORKERS];
+	int32 claimed = 0;
+	pthread_barrier_init(&s_claimBarrier, NULL, P2D_MAX_WORKERS);
+	for (int32 i = 0; i < P2D_MAX_WORKERS; ++i)
+	{
+		pthread_create(claimers + i, NULL, Claim, indices + i);
+	}
+	for (int32 i = 0; i < P2D_MAX_WORKERS; ++i)
+	{
+		pthread_join(claimers[i], NULL);
+		claimed |= indices[i] == P2D_NO_WORKER ? 0 : 1 << indices[i];
+	}
+	pthread_barrier_destroy(&s_claimBarrier);
+
+	s_allocator.Trim();
+	int32 chunks = 0;
+	for (int32 i = 0; i < BLOCK_SIZES; ++i)
+	{
+		chunks += s_allocator.GetStats(i).chunkCount;
+	}
+
+	if (s_errors != 0 || used != 0 || cached != 0 || chunks != 0 || claimed != (1 << P2D_MAX_WORKERS) - 1)
+	{
+		printf("failed: %d corrupted blocks, %d blocks leaked, %d blocks cached, %d chunks left, indices %x\n",
+			   s_errors, used, cached, chunks, claimed);
+		return 1;
+	}
+
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include "texturecache.h"
+
+#include <QCryptographicHash>
+#include <QPixmap>
+#include <QTransform>
+#include <qmath.h>
+
+// Stop halving below this many texels on the short side.
+static const int MIP_MINIMUM_SIZE = 8;
+static const int MIP_MAXIMUM_LEVELS = 8;
+
+
+TextureCache::TextureCache()
+{
+}
+
+QByteArray TextureCache::MakeKey(const QImage& image)
+{
+    // Size and format first, so images that only share their bytes differ.
+    QByteArray key;
+    key.append(QByteArray::number(image.width())).append('x')
+       .append(QByteArray::number(image.height())).append('@')
+       .append(QByteArray::number((int)image.format())).append(':');
+    key.append(QCryptographicHash::hash(
+                   QByteArray::fromRawData((const char*)image.constBits(), image.byteCount()),
+                   QCryptographicHash::Md5));
+    return key;
+}
+
+int TextureCache::Acquire(const QImage& image)
+{
+    if(image.isNull())
+        return -1;
+
+    QByteArray key = MakeKey(image);
+    QHash<QByteArray, int>::const_iterator found = ids.constFind(key);
+    if(found != ids.constEnd()){
+        entries[found.value()].references++;
+        return found.value();
+    }
+
+    int id;
+    if(!freeEntries.isEmpty()){
+        id = freeEntries.last();
+        freeEntries.pop_back();
+    } else {
+        id = entries.size();
+        entries.resize(id + 1);
+    }
+
+    Entry& entry = entries[id];
+    entry.key = key;
+    entry.references = 1;
+    entry.levels.clear();
+
+    // Level 0 is the image itself, every level after that halves the one before.
+    QImage level = image;
+    for(int i=0; i<MIP_MAXIMUM_LEVELS; i++){
+        QBrush brush(QPixmap::fromImage(level));
+        brush.setTransform(QTransform::fromScale(1 << i, 1 << i));
+        entry.levels.append(brush);
+
+        if(qMin(level.width(), level.height()) / 2 < MIP_MINIMUM_SIZE)
+            break;
+        level = level.scaled(level.width() / 2, level.height() / 2,
+                             Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    ids.insert(key, id);
+    return id;
+}
+
+void TextureCache::Release(int id)
+{
+    if(id < 0)
+        return;
+
+    Entry& entry = entries[id];
+    Q_ASSERT(entry.references > 0);
+    if(--entry.references > 0)
+        return;
+
+    ids.remove(entry.key);
+    entry.key.clear();
+    entry.levels.clear();
+    freeEntries.append(id);
+}
+
+int TextureCache::SelectLevel(int id, qreal scale) const
+{
+    // Drawn at half size or less, a level twice as small loses nothing.
+    int level = 0;
+    int count = entries.at(id).levels.size();
+    while(level + 1 < count && scale <= 0.5){
+        scale *= 2;
+        level++;
+    }
+    return level;
+}
@@ -0,0 +1,54 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QBrush>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+
+/// A shared store of item textures.
+/// Identical images are stored once, found by a hash of their pixels, and
+/// counted by reference. Each texture keeps a chain of pre-scaled mip
+/// levels, each halving the previous one, as pixmaps with a ready made
+/// brush, so painting never converts or scales an image.
+class TextureCache
+{
+public:
+    TextureCache();
+
+    /// Add a texture, or take another reference to an identical one.
+    /// The image is copied, it may change afterwards.
+    /// @return the id of the texture, -1 for a null image.
+    int Acquire(const QImage& image);
+
+    /// Drop a reference, the texture is freed with the last one.
+    void Release(int id);
+
+    /// Get the mip level to draw a texture with at a scale, in device pixels
+    /// per texel.
+    int SelectLevel(int id, qreal scale) const;
+
+    /// Get the brush of a mip level. It is scaled back up, so every level
+    /// covers the same area as the full size texture.
+    const QBrush& GetBrush(int id, int level) const {return entries.at(id).levels.at(level);}
+
+    /// Get the number of textures stored.
+    int GetCount() const {return ids.size();}
+
+private:
+    struct Entry
+    {
+        QByteArray key;             // empty if the entry is free
+        int references;
+        QVector<QBrush> levels;
+    };
+
+    static QByteArray MakeKey(const QImage& image);
+
+    QVector<Entry> entries;
+    QVector<int> freeEntries;
+    QHash<QByteArray, int> ids;
+};
+
+#endif // TEXTURECACHE_H